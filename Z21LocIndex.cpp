@@ -0,0 +1,344 @@
+/***********************************************************************************************************************
+   @file   Z21LocIndex.cpp
+   @brief  Z21 locomotive name index implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21LocIndex.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21LocIndex::Z21LocIndex() { Clear(); }
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21LocIndex::Clear()
+{
+    memset(m_Hash, 0, sizeof(m_Hash));
+    m_ArenaUsed = 0;
+    m_Count     = 0;
+    SearchReset();
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21LocIndex::Add(uint16_t Address, const char* NamePtr)
+{
+    bool Result     = true;
+    uint8_t Length  = 0;
+    uint16_t Slot   = HashSlot(Address);
+    uint8_t Entry;
+    char* NameOldPtr;
+
+    while ((Length < Z21_LOC_INDEX_NAME_LENGTH) && (NamePtr[Length] != '\0'))
+    {
+        Length++;
+    }
+
+    if (m_Hash[Slot] != 0)
+    {
+        Entry      = m_Hash[Slot] - 1;
+        NameOldPtr = &m_Arena[m_Entries[Entry].NameOffset];
+
+        if ((strncmp(NameOldPtr, NamePtr, Length) != 0) || (NameOldPtr[Length] != '\0'))
+        {
+            // Reuse the old name memory when the new name fits, the arena is only cleaned by Clear.
+            if (Length <= strlen(NameOldPtr))
+            {
+                SortRemove(Entry, m_Count);
+                memcpy(NameOldPtr, NamePtr, Length);
+                NameOldPtr[Length] = '\0';
+                SortInsert(Entry, m_Count - 1);
+            }
+            else if ((m_ArenaUsed + Length + 1) <= Z21_LOC_INDEX_ARENA_SIZE)
+            {
+                SortRemove(Entry, m_Count);
+                m_Entries[Entry].NameOffset = m_ArenaUsed;
+                memcpy(&m_Arena[m_ArenaUsed], NamePtr, Length);
+                m_Arena[m_ArenaUsed + Length] = '\0';
+                m_ArenaUsed += Length + 1;
+                SortInsert(Entry, m_Count - 1);
+            }
+            else
+            {
+                Result = false;
+            }
+        }
+    }
+    else if ((m_Count < Z21_LOC_INDEX_ENTRIES_MAX) && ((m_ArenaUsed + Length + 1) <= Z21_LOC_INDEX_ARENA_SIZE))
+    {
+        Entry                       = m_Count;
+        m_Entries[Entry].Address    = Address;
+        m_Entries[Entry].NameOffset = m_ArenaUsed;
+        memcpy(&m_Arena[m_ArenaUsed], NamePtr, Length);
+        m_Arena[m_ArenaUsed + Length] = '\0';
+        m_ArenaUsed += Length + 1;
+        m_Hash[Slot] = Entry + 1;
+        SortInsert(Entry, m_Count);
+        m_Count++;
+    }
+    else
+    {
+        Result = false;
+    }
+
+    SearchReplay();
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+const char* Z21LocIndex::Name(uint16_t Address)
+{
+    const char* NamePtr = NULL;
+    uint16_t Slot       = HashSlot(Address);
+
+    if (m_Hash[Slot] != 0)
+    {
+        NamePtr = &m_Arena[m_Entries[m_Hash[Slot] - 1].NameOffset];
+    }
+
+    return (NamePtr);
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocIndex::Count() { return (m_Count); }
+
+/***********************************************************************************************************************
+ */
+void Z21LocIndex::SearchReset()
+{
+    m_SearchLength = 0;
+    SearchReplay();
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocIndex::SearchAdd(char Character)
+{
+    if (m_SearchLength < Z21_LOC_INDEX_NAME_LENGTH)
+    {
+        m_SearchStr[m_SearchLength] = Character;
+        m_SearchLength++;
+        SearchNarrow();
+    }
+
+    return (SearchCount());
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocIndex::SearchRemove()
+{
+    // The ranges of the shorter prefixes are still valid.
+    if (m_SearchLength > 0)
+    {
+        m_SearchLength--;
+    }
+
+    return (SearchCount());
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocIndex::SearchCount() { return (m_SearchLast[m_SearchLength] - m_SearchFirst[m_SearchLength]); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocIndex::SearchAddress(uint8_t Index)
+{
+    uint16_t Address = 0;
+
+    if (Index < SearchCount())
+    {
+        Address = m_Entries[m_Sorted[m_SearchFirst[m_SearchLength] + Index]].Address;
+    }
+
+    return (Address);
+}
+
+/***********************************************************************************************************************
+ */
+const char* Z21LocIndex::SearchName(uint8_t Index)
+{
+    const char* NamePtr = NULL;
+
+    if (Index < SearchCount())
+    {
+        NamePtr = &m_Arena[m_Entries[m_Sorted[m_SearchFirst[m_SearchLength] + Index]].NameOffset];
+    }
+
+    return (NamePtr);
+}
+
+/***********************************************************************************************************************
+ * Open addressing with linear probing, entries are only removed by Clear so no deleted markers are needed.
+ */
+uint16_t Z21LocIndex::HashSlot(uint16_t Address)
+{
+    uint16_t Slot = (Address ^ (Address >> 7)) & (Z21_LOC_INDEX_HASH_SIZE - 1);
+
+    while ((m_Hash[Slot] != 0) && (m_Entries[m_Hash[Slot] - 1].Address != Address))
+    {
+        Slot = (Slot + 1) & (Z21_LOC_INDEX_HASH_SIZE - 1);
+    }
+
+    return (Slot);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21LocIndex::SortInsert(uint8_t Entry, uint8_t SortedCount)
+{
+    uint8_t Low         = 0;
+    uint8_t High        = SortedCount;
+    uint8_t Middle      = 0;
+    const char* NamePtr = &m_Arena[m_Entries[Entry].NameOffset];
+
+    // Insert behind equal names.
+    while (Low < High)
+    {
+        Middle = (Low + High) / 2;
+        if (Compare(&m_Arena[m_Entries[m_Sorted[Middle]].NameOffset], NamePtr) > 0)
+        {
+            High = Middle;
+        }
+        else
+        {
+            Low = Middle + 1;
+        }
+    }
+
+    memmove(&m_Sorted[Low + 1], &m_Sorted[Low], SortedCount - Low);
+    m_Sorted[Low] = Entry;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21LocIndex::SortRemove(uint8_t Entry, uint8_t SortedCount)
+{
+    uint8_t Index = 0;
+
+    while ((Index < SortedCount) && (m_Sorted[Index] != Entry))
+    {
+        Index++;
+    }
+
+    if (Index < SortedCount)
+    {
+        memmove(&m_Sorted[Index], &m_Sorted[Index + 1], SortedCount - Index - 1);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21LocIndex::SearchReplay()
+{
+    uint8_t Length = m_SearchLength;
+
+    m_SearchFirst[0] = 0;
+    m_SearchLast[0]  = m_Count;
+
+    for (m_SearchLength = 1; m_SearchLength <= Length; m_SearchLength++)
+    {
+        SearchNarrow();
+    }
+
+    m_SearchLength = Length;
+}
+
+/***********************************************************************************************************************
+ * Names in the range of the previous prefix all share that prefix, so they are sorted by the character at the new
+ * position. Two binary searches give the new range.
+ */
+void Z21LocIndex::SearchNarrow()
+{
+    uint8_t Position  = m_SearchLength - 1;
+    uint8_t Character = (uint8_t)(Upper(m_SearchStr[Position]));
+    uint8_t Low       = m_SearchFirst[Position];
+    uint8_t High      = m_SearchLast[Position];
+    uint8_t Middle;
+    uint8_t Found;
+
+    // First name with a character equal or above.
+    while (Low < High)
+    {
+        Middle = (Low + High) / 2;
+        if ((uint8_t)(Upper(m_Arena[m_Entries[m_Sorted[Middle]].NameOffset + Position])) < Character)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+    Found = Low;
+
+    // First name with a character above.
+    High = m_SearchLast[Position];
+    while (Low < High)
+    {
+        Middle = (Low + High) / 2;
+        if ((uint8_t)(Upper(m_Arena[m_Entries[m_Sorted[Middle]].NameOffset + Position])) <= Character)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    m_SearchFirst[m_SearchLength] = Found;
+    m_SearchLast[m_SearchLength]  = Low;
+}
+
+/***********************************************************************************************************************
+ */
+int16_t Z21LocIndex::Compare(const char* Name1Ptr, const char* Name2Ptr)
+{
+    uint8_t Index = 0;
+    uint8_t Character1;
+    uint8_t Character2;
+
+    do
+    {
+        Character1 = (uint8_t)(Upper(Name1Ptr[Index]));
+        Character2 = (uint8_t)(Upper(Name2Ptr[Index]));
+        Index++;
+    } while ((Character1 == Character2) && (Character1 != '\0'));
+
+    return ((int16_t)(Character1) - (int16_t)(Character2));
+}
+
+/***********************************************************************************************************************
+ */
+char Z21LocIndex::Upper(char Character)
+{
+    if ((Character >= 'a') && (Character <= 'z'))
+    {
+        Character = Character - 'a' + 'A';
+    }
+
+    return (Character);
+}
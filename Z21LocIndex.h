@@ -0,0 +1,143 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21LocIndex.h
+ * @brief Name index of the locomotive library with incremental prefix search and lookup of the name of an address.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_LOC_INDEX_H
+#define Z21_LOC_INDEX_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_LOC_INDEX_ENTRIES_MAX 64 //!< Maximum number of locomotives, 254 at most.
+#define Z21_LOC_INDEX_ARENA_SIZE 512 //!< Bytes for all names including the terminating zero.
+#define Z21_LOC_INDEX_HASH_SIZE 128  //!< Address hash table size, power of two larger than the maximum entries.
+#define Z21_LOC_INDEX_NAME_LENGTH 10 //!< Maximum name length.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21LocIndex
+{
+public:
+    /**
+     * Constructor
+     */
+    Z21LocIndex();
+
+    /**
+     * Remove all locomotives.
+     */
+    void Clear();
+
+    /**
+     * Add a locomotive or change its name. Returns false when the index or name memory is full.
+     */
+    bool Add(uint16_t Address, const char* NamePtr);
+
+    /**
+     * Name of a locomotive, NULL when the address is not present.
+     */
+    const char* Name(uint16_t Address);
+
+    /**
+     * Number of locomotives.
+     */
+    uint8_t Count();
+
+    /**
+     * Restart the search, all locomotives match.
+     */
+    void SearchReset();
+
+    /**
+     * Add a character to the search prefix, the comparison ignores case. Returns the number of matches.
+     */
+    uint8_t SearchAdd(char Character);
+
+    /**
+     * Remove the last character of the search prefix. Returns the number of matches.
+     */
+    uint8_t SearchRemove();
+
+    /**
+     * Number of locomotives matching the search prefix.
+     */
+    uint8_t SearchCount();
+
+    /**
+     * Address of a match, sorted by name.
+     */
+    uint16_t SearchAddress(uint8_t Index);
+
+    /**
+     * Name of a match, sorted by name.
+     */
+    const char* SearchName(uint8_t Index);
+
+private:
+    /**
+     * Typedef struct for an entry, the name is stored in the arena.
+     */
+    typedef struct
+    {
+        uint16_t Address;
+        uint16_t NameOffset;
+    } indexEntry;
+
+    indexEntry m_Entries[Z21_LOC_INDEX_ENTRIES_MAX];      /* Locomotives in order of adding. */
+    uint8_t m_Sorted[Z21_LOC_INDEX_ENTRIES_MAX];          /* Entries sorted by name. */
+    uint8_t m_Hash[Z21_LOC_INDEX_HASH_SIZE];              /* Entry + 1 per address hash, 0 is empty. */
+    char m_Arena[Z21_LOC_INDEX_ARENA_SIZE];               /* Names. */
+    uint16_t m_ArenaUsed;                                 /* Used bytes of the arena. */
+    uint8_t m_Count;                                      /* Number of entries. */
+    char m_SearchStr[Z21_LOC_INDEX_NAME_LENGTH + 1];      /* Search prefix. */
+    uint8_t m_SearchLength;                               /* Length of search prefix. */
+    uint8_t m_SearchFirst[Z21_LOC_INDEX_NAME_LENGTH + 1]; /* First sorted match per prefix length. */
+    uint8_t m_SearchLast[Z21_LOC_INDEX_NAME_LENGTH + 1];  /* Last sorted match + 1 per prefix length. */
+
+    /**
+     * Find the hash slot of an address, the slot is empty when the address is not present.
+     */
+    uint16_t HashSlot(uint16_t Address);
+
+    /**
+     * Insert an entry in the sorted list of SortedCount entries.
+     */
+    void SortInsert(uint8_t Entry, uint8_t SortedCount);
+
+    /**
+     * Remove an entry from the sorted list of SortedCount entries.
+     */
+    void SortRemove(uint8_t Entry, uint8_t SortedCount);
+
+    /**
+     * Determine the match ranges of all prefix lengths again after the sorted list changed.
+     */
+    void SearchReplay();
+
+    /**
+     * Narrow the range of the previous prefix length to the names with the character at the last prefix position.
+     */
+    void SearchNarrow();
+
+    /**
+     * Compare names ignoring case.
+     */
+    int16_t Compare(const char* Name1Ptr, const char* Name2Ptr);
+
+    /**
+     * Character in upper case.
+     */
+    char Upper(char Character);
+};
+
+#endif
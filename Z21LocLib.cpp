@@ -0,0 +1,193 @@
+/***********************************************************************************************************************
+   @file   Z21LocLib.cpp
+   @brief  Z21 locomotive library image implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21LocLib.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21LocLib::Z21LocLib() { Clear(); }
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21LocLib::Clear()
+{
+    memset(&m_Image, 0, sizeof(m_Image));
+    m_Image.Header.Magic    = Z21_LOC_LIB_MAGIC;
+    m_Image.Header.Version  = Z21_LOC_LIB_VERSION;
+    m_Image.Header.Count    = 0;
+    m_Image.Header.Checksum = Checksum(&m_Image);
+    m_Changed               = false;
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21LocLib::Load(const uint8_t* ImagePtr, uint16_t Length)
+{
+    bool Result = false;
+    locLibHeader Header;
+
+    Clear();
+
+    if (Length >= sizeof(locLibHeader))
+    {
+        memcpy(&Header, ImagePtr, sizeof(locLibHeader));
+
+        if ((Header.Magic == Z21_LOC_LIB_MAGIC) && (Header.Version == Z21_LOC_LIB_VERSION)
+            && (Header.Count <= Z21_LOC_LIB_ENTRIES_MAX)
+            && (Length >= (sizeof(locLibHeader) + (Header.Count * sizeof(locLibEntry)))))
+        {
+            memcpy(&m_Image, ImagePtr, sizeof(locLibHeader) + (Header.Count * sizeof(locLibEntry)));
+
+            if (Checksum(&m_Image) == Header.Checksum)
+            {
+                Result = true;
+            }
+            else
+            {
+                Clear();
+            }
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21LocLib::Image() { return ((const uint8_t*)(&m_Image)); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocLib::ImageSize() { return (sizeof(locLibHeader) + (m_Image.Header.Count * sizeof(locLibEntry))); }
+
+/***********************************************************************************************************************
+ */
+bool Z21LocLib::Update(const Z21Slave::locLibData* LocLibDataPtr)
+{
+    bool Result = false;
+    locLibEntry* EntryPtr;
+    uint16_t Count = LocLibDataPtr->Total;
+
+    if (Count > Z21_LOC_LIB_ENTRIES_MAX)
+    {
+        Count = Z21_LOC_LIB_ENTRIES_MAX;
+    }
+
+    if (LocLibDataPtr->Actual < Count)
+    {
+        // Only write when the entry differs, so an unchanged library does not have to be stored again.
+        EntryPtr = &m_Image.Entries[LocLibDataPtr->Actual];
+        if ((EntryPtr->Address != LocLibDataPtr->Address) || (EntryPtr->Index != LocLibDataPtr->Actual)
+            || (memcmp(EntryPtr->NameStr, LocLibDataPtr->NameStr, sizeof(EntryPtr->NameStr)) != 0))
+        {
+            EntryPtr->Address = LocLibDataPtr->Address;
+            EntryPtr->Index   = (uint8_t)(LocLibDataPtr->Actual);
+            memcpy(EntryPtr->NameStr, LocLibDataPtr->NameStr, sizeof(EntryPtr->NameStr));
+            Result = true;
+        }
+
+        // A smaller total means locomotives were removed from the library.
+        if (m_Image.Header.Count != Count)
+        {
+            if (Count < m_Image.Header.Count)
+            {
+                memset(&m_Image.Entries[Count], 0, (m_Image.Header.Count - Count) * sizeof(locLibEntry));
+            }
+            m_Image.Header.Count = Count;
+            Result               = true;
+        }
+    }
+
+    if (Result == true)
+    {
+        m_Image.Header.Checksum = Checksum(&m_Image);
+        m_Changed               = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21LocLib::Changed() { return (m_Changed); }
+
+/***********************************************************************************************************************
+ */
+void Z21LocLib::Stored() { m_Changed = false; }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocLib::Count() { return (m_Image.Header.Count); }
+
+/***********************************************************************************************************************
+ */
+const Z21LocLib::locLibEntry* Z21LocLib::Entry(uint16_t Index)
+{
+    const locLibEntry* EntryPtr = NULL;
+
+    if (Index < m_Image.Header.Count)
+    {
+        EntryPtr = &m_Image.Entries[Index];
+    }
+
+    return (EntryPtr);
+}
+
+/***********************************************************************************************************************
+ */
+const Z21LocLib::locLibEntry* Z21LocLib::Find(uint16_t Address)
+{
+    uint16_t Index              = 0;
+    const locLibEntry* EntryPtr = NULL;
+
+    while ((EntryPtr == NULL) && (Index < m_Image.Header.Count))
+    {
+        if (m_Image.Entries[Index].Address == Address)
+        {
+            EntryPtr = &m_Image.Entries[Index];
+        }
+        Index++;
+    }
+
+    return (EntryPtr);
+}
+
+/***********************************************************************************************************************
+ * Fletcher-16 over the count and the used entries.
+ */
+uint16_t Z21LocLib::Checksum(const locLibImage* ImagePtr)
+{
+    uint16_t Index;
+    uint16_t Sum1           = (uint8_t)(ImagePtr->Header.Count);
+    uint16_t Sum2           = Sum1;
+    const uint8_t* EntryPtr = (const uint8_t*)(ImagePtr->Entries);
+    uint16_t Length         = ImagePtr->Header.Count * sizeof(locLibEntry);
+
+    for (Index = 0; Index < Length; Index++)
+    {
+        Sum1 = (Sum1 + EntryPtr[Index]) % 255;
+        Sum2 = (Sum2 + Sum1) % 255;
+    }
+
+    return ((uint16_t)((Sum2 << 8) | Sum1));
+}
@@ -0,0 +1,129 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21LocLib.h
+ * @brief Locomotive library image which can be stored in flash or a file and loaded at startup, so the library does
+ *        not have to be received again.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_LOC_LIB_H
+#define Z21_LOC_LIB_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_LOC_LIB_ENTRIES_MAX 64     //!< Maximum number of locomotives in the library image.
+#define Z21_LOC_LIB_MAGIC 0x4C31325AUL //!< Image identification "Z21L".
+#define Z21_LOC_LIB_VERSION 1          //!< Image layout version.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21LocLib
+{
+public:
+    /**
+     * Image header, all members are little endian on the supported targets.
+     */
+    struct locLibHeader
+    {
+        uint32_t Magic;
+        uint16_t Version;
+        uint16_t Count;
+        uint16_t Checksum;
+        uint16_t Reserved;
+    };
+
+    /**
+     * Image entry of one locomotive, 14 bytes without padding.
+     */
+    struct locLibEntry
+    {
+        uint16_t Address;
+        uint8_t Index;
+        char NameStr[11];
+    };
+
+    /**
+     * Image, only the header and the first Count entries are stored.
+     */
+    struct locLibImage
+    {
+        locLibHeader Header;
+        locLibEntry Entries[Z21_LOC_LIB_ENTRIES_MAX];
+    };
+
+    /**
+     * Constructor
+     */
+    Z21LocLib();
+
+    /**
+     * Remove all locomotives.
+     */
+    void Clear();
+
+    /**
+     * Load an image read from flash, a file or a memory mapped file. Returns false and keeps an empty library when
+     * the magic, version, size or checksum is wrong.
+     */
+    bool Load(const uint8_t* ImagePtr, uint16_t Length);
+
+    /**
+     * Image to be stored.
+     */
+    const uint8_t* Image();
+
+    /**
+     * Number of bytes of the image to be stored.
+     */
+    uint16_t ImageSize();
+
+    /**
+     * Update the library with received loclibrary data. Returns true when the image changed.
+     */
+    bool Update(const Z21Slave::locLibData* LocLibDataPtr);
+
+    /**
+     * Check if the image changed since the last load or store.
+     */
+    bool Changed();
+
+    /**
+     * Mark the image as stored.
+     */
+    void Stored();
+
+    /**
+     * Number of locomotives.
+     */
+    uint16_t Count();
+
+    /**
+     * Locomotive at library index, NULL when not present.
+     */
+    const locLibEntry* Entry(uint16_t Index);
+
+    /**
+     * Locomotive with address, NULL when not present.
+     */
+    const locLibEntry* Find(uint16_t Address);
+
+private:
+    locLibImage m_Image; /* Library image. */
+    bool m_Changed;      /* Image changed since load or store. */
+
+    /**
+     * Calculate the checksum of the count and entries.
+     */
+    uint16_t Checksum(const locLibImage* ImagePtr);
+};
+
+#endif
@@ -0,0 +1,158 @@
+/***********************************************************************************************************************
+   @file   Z21LocoNet.cpp
+   @brief  LocoNet message view implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21LocoNet.h"
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21LocoNetMessage::Z21LocoNetMessage()
+{
+    m_DataPtr = NULL;
+    m_Length  = 0;
+    m_Valid   = false;
+}
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21LocoNetMessage::Set(const uint8_t* DataPtr, uint8_t Length)
+{
+    uint8_t MessageLength = 0;
+
+    m_DataPtr = DataPtr;
+    m_Length  = Length;
+    m_Valid   = false;
+
+    if (Length >= 2)
+    {
+        // Bits 6 and 5 of the opcode give the length, 0x60 means the length is in the second byte.
+        switch (DataPtr[0] & 0x60)
+        {
+        case 0x00: MessageLength = 2; break;
+        case 0x20: MessageLength = 4; break;
+        case 0x40: MessageLength = 6; break;
+        default: MessageLength = DataPtr[1]; break;
+        }
+
+        if ((MessageLength >= 2) && (MessageLength <= Length) && ((DataPtr[0] & 0x80) != 0))
+        {
+            m_Length = MessageLength;
+            m_Valid  = (Checksum(DataPtr, MessageLength) == DataPtr[MessageLength - 1]);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21LocoNetMessage::Valid() { return (m_Valid); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::Opcode() { return ((m_Valid == true) ? m_DataPtr[0] : 0); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::Length() { return (m_Length); }
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21LocoNetMessage::Data() { return ((m_Valid == true) ? m_DataPtr : NULL); }
+
+/***********************************************************************************************************************
+ */
+bool Z21LocoNetMessage::IsSlotRead()
+{
+    return ((m_Valid == true) && (m_DataPtr[0] == Z21_LOCONET_OPC_SL_RD_DATA) && (m_Length == 14));
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::SlotNumber() { return ((IsSlotRead() == true) ? m_DataPtr[2] : 0); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::SlotStatus() { return ((IsSlotRead() == true) ? m_DataPtr[3] : 0); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocoNetMessage::SlotAddress()
+{
+    uint16_t Address = 0;
+
+    if (IsSlotRead() == true)
+    {
+        Address = (uint16_t)(m_DataPtr[4]) | ((uint16_t)(m_DataPtr[9]) << 7);
+    }
+
+    return (Address);
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::SlotSpeed() { return ((IsSlotRead() == true) ? m_DataPtr[5] : 0); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::SlotDirf() { return ((IsSlotRead() == true) ? m_DataPtr[6] : 0); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::SlotSound() { return ((IsSlotRead() == true) ? m_DataPtr[10] : 0); }
+
+/***********************************************************************************************************************
+ */
+bool Z21LocoNetMessage::IsInputReport() { return ((m_Valid == true) && (m_DataPtr[0] == Z21_LOCONET_OPC_INPUT_REP)); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocoNetMessage::InputAddress()
+{
+    uint16_t Address = 0;
+
+    if (IsInputReport() == true)
+    {
+        Address = (uint16_t)(m_DataPtr[1] & 0x7F) | ((uint16_t)(m_DataPtr[2] & 0x0F) << 7);
+
+        // The I bit selects the odd or even input of the pair.
+        Address = (Address << 1) + ((m_DataPtr[2] & 0x20) ? 1 : 0) + 1;
+    }
+
+    return (Address);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21LocoNetMessage::InputOccupied() { return ((IsInputReport() == true) && ((m_DataPtr[2] & 0x10) != 0)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetMessage::Checksum(const uint8_t* DataPtr, uint8_t Length)
+{
+    uint8_t Index;
+    uint8_t Checksum = 0xFF;
+
+    for (Index = 0; Index < (Length - 1); Index++)
+    {
+        Checksum ^= DataPtr[Index];
+    }
+
+    return (Checksum);
+}
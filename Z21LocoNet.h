@@ -0,0 +1,121 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21LocoNet.h
+ * @brief View on a LocoNet message tunneled in a Z21 message. The view points into the received data, so it is only
+ *        valid as long as the receive buffer is not reused.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_LOCONET_H
+#define Z21_LOCONET_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_LOCONET_OPC_INPUT_REP 0xB2  //!< Sensor (occupancy detector) report.
+#define Z21_LOCONET_OPC_SL_RD_DATA 0xE7 //!< Slot read data.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21LocoNetMessage
+{
+public:
+    /**
+     * Constructor
+     */
+    Z21LocoNetMessage();
+
+    /**
+     * Point the view to a LocoNet message and check the length and checksum.
+     */
+    void Set(const uint8_t* DataPtr, uint8_t Length);
+
+    /**
+     * Check if the length matches the opcode and the checksum is correct. Accessors may only be used when valid.
+     */
+    bool Valid();
+
+    /**
+     * Opcode of the message, 0 when not valid.
+     */
+    uint8_t Opcode();
+
+    /**
+     * Length of the message including opcode and checksum.
+     */
+    uint8_t Length();
+
+    /**
+     * Message data including opcode and checksum, NULL when not valid.
+     */
+    const uint8_t* Data();
+
+    /**
+     * Check for OPC_SL_RD_DATA.
+     */
+    bool IsSlotRead();
+
+    /**
+     * OPC_SL_RD_DATA slot number, 0 when not a valid slot read.
+     */
+    uint8_t SlotNumber();
+
+    /**
+     * OPC_SL_RD_DATA slot status, 0 when not a valid slot read.
+     */
+    uint8_t SlotStatus();
+
+    /**
+     * OPC_SL_RD_DATA locomotive address, 0 when not a valid slot read.
+     */
+    uint16_t SlotAddress();
+
+    /**
+     * OPC_SL_RD_DATA speed, 0 when not a valid slot read.
+     */
+    uint8_t SlotSpeed();
+
+    /**
+     * OPC_SL_RD_DATA direction and functions F0..F4, 0 when not a valid slot read.
+     */
+    uint8_t SlotDirf();
+
+    /**
+     * OPC_SL_RD_DATA functions F5..F8, 0 when not a valid slot read.
+     */
+    uint8_t SlotSound();
+
+    /**
+     * Check for OPC_INPUT_REP.
+     */
+    bool IsInputReport();
+
+    /**
+     * OPC_INPUT_REP sensor address starting at 1, 0 when not a valid input report.
+     */
+    uint16_t InputAddress();
+
+    /**
+     * OPC_INPUT_REP sensor occupied, false when not a valid input report.
+     */
+    bool InputOccupied();
+
+    /**
+     * Calculate the checksum of a message, the last byte (the checksum itself) is excluded.
+     */
+    static uint8_t Checksum(const uint8_t* DataPtr, uint8_t Length);
+
+private:
+    const uint8_t* m_DataPtr; /* Message in the receive buffer. */
+    uint8_t m_Length;         /* Message length. */
+    bool m_Valid;             /* Length and checksum ok. */
+};
+
+#endif
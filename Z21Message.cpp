@@ -0,0 +1,237 @@
+/***********************************************************************************************************************
+   @file   Z21Message.cpp
+   @brief  Z21 received message views implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Message.h"
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+bool Z21Message::Valid() { return (m_Valid); }
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21Message::Data() { return (m_DataPtr); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Message::DataLen() { return (m_DataLen); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Message::Header() { return (m_DataPtr[2]); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21Message::Word(uint8_t Index)
+{
+    return ((uint16_t)(m_DataPtr[Index]) | ((uint16_t)(m_DataPtr[Index + 1]) << 8));
+}
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21Message::WordBigEndian(uint8_t Index)
+{
+    return (((uint16_t)(m_DataPtr[Index]) << 8) | (uint16_t)(m_DataPtr[Index + 1]));
+}
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21Message::DoubleWord(uint8_t Index)
+{
+    return ((uint32_t)(Word(Index)) | ((uint32_t)(Word(Index + 2)) << 16));
+}
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21SerialNumberMessage::SerialNumber() { return (DoubleWord(4)); }
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21HwInfoMessage::HwType() { return (DoubleWord(4)); }
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21HwInfoMessage::FirmwareVersion() { return (DoubleWord(8)); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21SystemStateMessage::MainCurrent() { return ((int16_t)(Word(4))); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21SystemStateMessage::ProgCurrent() { return ((int16_t)(Word(6))); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21SystemStateMessage::FilteredMainCurrent() { return ((int16_t)(Word(8))); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21SystemStateMessage::Temperature() { return ((int16_t)(Word(10))); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21SystemStateMessage::SupplyVoltage() { return (Word(12)); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21SystemStateMessage::VccVoltage() { return (Word(14)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21SystemStateMessage::CentralState() { return (m_DataPtr[16]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21SystemStateMessage::CentralStateEx() { return (m_DataPtr[17]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21SystemStateMessage::Capabilities() { return (m_DataPtr[19]); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21RailComMessage::Address() { return (Word(4)); }
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21RailComMessage::ReceiveCounter() { return (DoubleWord(6)); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21RailComMessage::ErrorCounter() { return (Word(10)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21RailComMessage::Options() { return (m_DataPtr[13]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21RailComMessage::Speed() { return (m_DataPtr[14]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21RailComMessage::Qos() { return (m_DataPtr[15]); }
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21LocoNetDataMessage::LocoNetData() { return (&m_DataPtr[4]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetDataMessage::LocoNetLength() { return ((uint8_t)(m_DataLen - 4)); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocoNetDispatchMessage::Address() { return (Word(4)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetDispatchMessage::Result() { return (m_DataPtr[6]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetDetectorMessage::Type() { return (m_DataPtr[4]); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21LocoNetDetectorMessage::Address() { return (Word(5)); }
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21LocoNetDetectorMessage::Info() { return (&m_DataPtr[7]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21LocoNetDetectorMessage::InfoLength() { return ((uint8_t)(m_DataLen - 7)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XBroadcastMessage::Db0() { return (m_DataPtr[5]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XStatusChangedMessage::CentralState() { return (m_DataPtr[6]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XVersionMessage::XBusVersion() { return (m_DataPtr[6]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XVersionMessage::CommandStationId() { return (m_DataPtr[7]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XFirmwareVersionMessage::Major() { return (m_DataPtr[6]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XFirmwareVersionMessage::Minor() { return (m_DataPtr[7]); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21XCvResultMessage::CvAddress() { return (WordBigEndian(6)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XCvResultMessage::CvValue() { return (m_DataPtr[8]); }
+
+/***********************************************************************************************************************
+ * Long addresses have the two upper bits set.
+ */
+uint16_t Z21XLocInfoMessage::Address()
+{
+    uint16_t Address = WordBigEndian(5);
+
+    return (Address - ((uint16_t)((Address & 0xC000) == 0xC000) * 0xC000));
+}
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21XLocInfoMessage::Db2ToDb7() { return (&m_DataPtr[7]); }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21XLocLibMessage::Address() { return (WordBigEndian(6)); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XLocLibMessage::Actual() { return (m_DataPtr[8]); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21XLocLibMessage::Total() { return (m_DataPtr[9]); }
+
+/***********************************************************************************************************************
+ */
+const uint8_t* Z21XLocLibMessage::Name() { return (&m_DataPtr[10]); }
+
+/***********************************************************************************************************************
+ * The name ends in front of the XOR byte and has at most 10 characters.
+ */
+uint8_t Z21XLocLibMessage::NameLength()
+{
+    uint8_t Length  = (uint8_t)(m_DataPtr[4] - 0xE5);
+    uint8_t Maximum = (uint8_t)(m_DataLen - 11);
+
+    Length = (Length < Maximum) ? Length : Maximum;
+
+    return ((Length < 10) ? Length : 10);
+}
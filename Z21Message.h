@@ -0,0 +1,434 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21Message.h
+ * @brief Views on received Z21 messages. The constructor of each view checks DataLen, the minimum length of the
+ *        message type and the XOR byte of X-Bus messages in one pass. When Valid() returns true the accessors read
+ *        the fields without further checks, they may not be used on a view which is not valid. The constructors are
+ *        inline, they run for every received message.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_MESSAGE_H
+#define Z21_MESSAGE_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include <Arduino.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21Message
+{
+public:
+    /**
+     * Constructor, validates a message of any type at the start of the received data.
+     */
+    Z21Message(const uint8_t* DataPtr, uint16_t Length);
+
+    /**
+     * DataLen of the message at the start of the received data, 0 when the data does not hold a complete message.
+     * Only DataLen is checked, so the next message of a datagram can be found without validating this one.
+     */
+    static uint8_t FramedLength(const uint8_t* DataPtr, uint16_t Length);
+
+    /**
+     * Check if the message is complete, long enough for its type and the XOR byte is correct.
+     */
+    bool Valid();
+
+    /**
+     * Message data starting with DataLen.
+     */
+    const uint8_t* Data();
+
+    /**
+     * DataLen of the message.
+     */
+    uint8_t DataLen();
+
+    /**
+     * Header of the message.
+     */
+    uint8_t Header();
+
+protected:
+    const uint8_t* m_DataPtr; /* Received data. */
+    uint8_t m_DataLen;        /* DataLen of the message. */
+    bool m_Valid;             /* Message is valid. */
+
+    /**
+     * Constructor for the views of a message type, the minimum length includes the XOR byte.
+     */
+    Z21Message(const uint8_t* DataPtr, uint16_t Length, uint8_t MinimumLength);
+
+    /**
+     * Little endian 16 bit value at the index.
+     */
+    uint16_t Word(uint8_t Index);
+
+    /**
+     * Big endian 16 bit value at the index, used by the X-Bus messages.
+     */
+    uint16_t WordBigEndian(uint8_t Index);
+
+    /**
+     * Little endian 32 bit value at the index.
+     */
+    uint32_t DoubleWord(uint8_t Index);
+};
+
+/**
+ * 2.1 LAN_GET_SERIAL_NUMBER response.
+ */
+class Z21SerialNumberMessage : public Z21Message
+{
+public:
+    Z21SerialNumberMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint32_t SerialNumber();
+};
+
+/**
+ * 2.20 LAN_GET_HWINFO response.
+ */
+class Z21HwInfoMessage : public Z21Message
+{
+public:
+    Z21HwInfoMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint32_t HwType();
+    uint32_t FirmwareVersion();
+};
+
+/**
+ * 2.18 LAN_SYSTEMSTATE_DATACHANGED.
+ */
+class Z21SystemStateMessage : public Z21Message
+{
+public:
+    Z21SystemStateMessage(const uint8_t* DataPtr, uint16_t Length);
+    int16_t MainCurrent();
+    int16_t ProgCurrent();
+    int16_t FilteredMainCurrent();
+    int16_t Temperature();
+    uint16_t SupplyVoltage();
+    uint16_t VccVoltage();
+    uint8_t CentralState();
+    uint8_t CentralStateEx();
+    uint8_t Capabilities();
+};
+
+/**
+ * 8.1 LAN_RAILCOM_DATACHANGED.
+ */
+class Z21RailComMessage : public Z21Message
+{
+public:
+    Z21RailComMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint16_t Address();
+    uint32_t ReceiveCounter();
+    uint16_t ErrorCounter();
+    uint8_t Options();
+    uint8_t Speed();
+    uint8_t Qos();
+};
+
+/**
+ * 9.1 - 9.3 LAN_LOCONET_Z21_RX, LAN_LOCONET_Z21_TX and LAN_LOCONET_FROM_LAN, the LocoNet message has at least
+ * opcode and checksum.
+ */
+class Z21LocoNetDataMessage : public Z21Message
+{
+public:
+    Z21LocoNetDataMessage(const uint8_t* DataPtr, uint16_t Length);
+    const uint8_t* LocoNetData();
+    uint8_t LocoNetLength();
+};
+
+/**
+ * 9.4 LAN_LOCONET_DISPATCH_ADDR response.
+ */
+class Z21LocoNetDispatchMessage : public Z21Message
+{
+public:
+    Z21LocoNetDispatchMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint16_t Address();
+    uint8_t Result();
+};
+
+/**
+ * 9.5 LAN_LOCONET_DETECTOR.
+ */
+class Z21LocoNetDetectorMessage : public Z21Message
+{
+public:
+    Z21LocoNetDetectorMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint8_t Type();
+    uint16_t Address();
+    const uint8_t* Info();
+    uint8_t InfoLength();
+};
+
+/**
+ * X-Bus broadcasts with X-Header 0x61 like LAN_X_BC_TRACK_POWER_OFF, DB0 gives the broadcast.
+ */
+class Z21XBroadcastMessage : public Z21Message
+{
+public:
+    Z21XBroadcastMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint8_t Db0();
+};
+
+/**
+ * 2.12 LAN_X_STATUS_CHANGED.
+ */
+class Z21XStatusChangedMessage : public Z21Message
+{
+public:
+    Z21XStatusChangedMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint8_t CentralState();
+};
+
+/**
+ * 2.3 LAN_X_GET_VERSION response.
+ */
+class Z21XVersionMessage : public Z21Message
+{
+public:
+    Z21XVersionMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint8_t XBusVersion();
+    uint8_t CommandStationId();
+};
+
+/**
+ * 2.15 LAN_X_GET_FIRMWARE_VERSION response.
+ */
+class Z21XFirmwareVersionMessage : public Z21Message
+{
+public:
+    Z21XFirmwareVersionMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint8_t Major();
+    uint8_t Minor();
+};
+
+/**
+ * 6.5 LAN_X_CV_RESULT, the CV address starts at 0.
+ */
+class Z21XCvResultMessage : public Z21Message
+{
+public:
+    Z21XCvResultMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint16_t CvAddress();
+    uint8_t CvValue();
+};
+
+/**
+ * 4.4 LAN_X_LOCO_INFO, DB2..DB7 hold speed steps, speed, direction, light and functions F1..F28.
+ */
+class Z21XLocInfoMessage : public Z21Message
+{
+public:
+    Z21XLocInfoMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint16_t Address();
+    const uint8_t* Db2ToDb7();
+};
+
+/**
+ * Loc library data, the X-Header 0xE5..0xEF gives the length of the name.
+ */
+class Z21XLocLibMessage : public Z21Message
+{
+public:
+    Z21XLocLibMessage(const uint8_t* DataPtr, uint16_t Length);
+    uint16_t Address();
+    uint8_t Actual();
+    uint8_t Total();
+    const uint8_t* Name();
+    uint8_t NameLength();
+};
+
+/***********************************************************************************************************************
+ * I N L I N E
+ **********************************************************************************************************************/
+
+// The framing and the constructors are on the receive path of every message, they are defined here so they are inlined
+// and the minimum length of each view is a constant.
+
+/***********************************************************************************************************************
+ */
+inline uint8_t Z21Message::FramedLength(const uint8_t* DataPtr, uint16_t Length)
+{
+    uint8_t Result = 0;
+    uint16_t DataLen;
+    uint16_t Limit = (Length < 0xFF) ? Length : 0xFF;
+
+    // DataLen may be smaller than the received length when more messages are in one datagram. Z21 messages are never
+    // longer than 255 bytes, so 4 <= DataLen <= Limit is checked with a single compare.
+    if (Length >= 4)
+    {
+        DataLen = (uint16_t)(DataPtr[0]) | ((uint16_t)(DataPtr[1]) << 8);
+        if ((uint16_t)(DataLen - 4) <= (uint16_t)(Limit - 4))
+        {
+            Result = (uint8_t)DataLen;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21Message::Z21Message(const uint8_t* DataPtr, uint16_t Length, uint8_t MinimumLength)
+{
+    uint8_t Index;
+    uint8_t Checksum;
+    uint16_t DataLen;
+    uint16_t Limit = (Length < 0xFF) ? Length : 0xFF;
+    uint32_t Checksum32 = 0;
+    uint32_t Word32;
+
+    m_DataPtr = DataPtr;
+    m_DataLen = 0;
+    m_Valid   = false;
+
+    if (Length >= MinimumLength)
+    {
+        DataLen = (uint16_t)(DataPtr[0]) | ((uint16_t)(DataPtr[1]) << 8);
+        if ((uint16_t)(DataLen - MinimumLength) <= (uint16_t)(Limit - MinimumLength))
+        {
+            m_DataLen = (uint8_t)DataLen;
+            m_Valid   = true;
+
+            // X-Bus messages have at least X-Header and XOR byte, the XOR including the XOR byte is 0. The bytes up
+            // to the minimum length are a constant count, they are combined 32 bits at a time.
+            if (DataPtr[2] == 0x40)
+            {
+                for (Index = 4; (Index + 4) <= MinimumLength; Index += 4)
+                {
+                    memcpy(&Word32, &DataPtr[Index], sizeof(Word32));
+                    Checksum32 ^= Word32;
+                }
+                Checksum32 ^= Checksum32 >> 16;
+                Checksum32 ^= Checksum32 >> 8;
+                Checksum = (uint8_t)Checksum32;
+
+                for (; Index < MinimumLength; Index++)
+                {
+                    Checksum ^= DataPtr[Index];
+                }
+                for (; Index < m_DataLen; Index++)
+                {
+                    Checksum ^= DataPtr[Index];
+                }
+                m_Valid = (m_DataLen >= 6) && (Checksum == 0);
+            }
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21Message::Z21Message(const uint8_t* DataPtr, uint16_t Length) : Z21Message(DataPtr, Length, 4) {}
+
+/***********************************************************************************************************************
+ */
+inline Z21SerialNumberMessage::Z21SerialNumberMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 8)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21HwInfoMessage::Z21HwInfoMessage(const uint8_t* DataPtr, uint16_t Length) : Z21Message(DataPtr, Length, 12)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21SystemStateMessage::Z21SystemStateMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 20)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21RailComMessage::Z21RailComMessage(const uint8_t* DataPtr, uint16_t Length) : Z21Message(DataPtr, Length, 17)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21LocoNetDataMessage::Z21LocoNetDataMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 6)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21LocoNetDispatchMessage::Z21LocoNetDispatchMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 7)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21LocoNetDetectorMessage::Z21LocoNetDetectorMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 7)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XBroadcastMessage::Z21XBroadcastMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 7)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XStatusChangedMessage::Z21XStatusChangedMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 8)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XVersionMessage::Z21XVersionMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 9)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XFirmwareVersionMessage::Z21XFirmwareVersionMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 9)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XCvResultMessage::Z21XCvResultMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 10)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XLocInfoMessage::Z21XLocInfoMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 14)
+{
+}
+
+/***********************************************************************************************************************
+ */
+inline Z21XLocLibMessage::Z21XLocLibMessage(const uint8_t* DataPtr, uint16_t Length)
+    : Z21Message(DataPtr, Length, 11)
+{
+}
+
+#endif
@@ -0,0 +1,174 @@
+/***********************************************************************************************************************
+   @file   Z21RailCom.cpp
+   @brief  Z21 RailCom history implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21RailCom.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21RailCom::Z21RailCom() { Clear(); }
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21RailCom::Clear()
+{
+    uint8_t Index;
+
+    memset(m_Pool, 0, sizeof(m_Pool));
+
+    for (Index = 0; Index < Z21_RAILCOM_LOCS_MAX; Index++)
+    {
+        m_Free[Index] = Index;
+    }
+
+    m_NrOfFree = Z21_RAILCOM_LOCS_MAX;
+    m_Sequence = 0;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21RailCom::Add(const Z21Slave::railCom* RailComPtr)
+{
+    railComHistory* HistoryPtr = Find(RailComPtr->Address);
+
+    if (HistoryPtr == NULL)
+    {
+        HistoryPtr = Allocate();
+    }
+
+    // Replace the oldest sample in the sums by the new one.
+    if (HistoryPtr->Samples < Z21_RAILCOM_HISTORY_SIZE)
+    {
+        HistoryPtr->Samples++;
+    }
+    else
+    {
+        HistoryPtr->SpeedSum -= HistoryPtr->Speed[HistoryPtr->Head];
+        HistoryPtr->QosSum -= HistoryPtr->Qos[HistoryPtr->Head];
+    }
+
+    HistoryPtr->Speed[HistoryPtr->Head] = RailComPtr->Speed;
+    HistoryPtr->Qos[HistoryPtr->Head]   = RailComPtr->Qos;
+    HistoryPtr->SpeedSum += RailComPtr->Speed;
+    HistoryPtr->QosSum += RailComPtr->Qos;
+    HistoryPtr->Head = (HistoryPtr->Head + 1) % Z21_RAILCOM_HISTORY_SIZE;
+
+    HistoryPtr->Latest   = *RailComPtr;
+    HistoryPtr->Sequence = m_Sequence++;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21RailCom::Remove(uint16_t Address)
+{
+    railComHistory* HistoryPtr = Find(Address);
+
+    if (HistoryPtr != NULL)
+    {
+        HistoryPtr->Used   = false;
+        m_Free[m_NrOfFree] = (uint8_t)(HistoryPtr - m_Pool);
+        m_NrOfFree++;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+const Z21Slave::railCom* Z21RailCom::Latest(uint16_t Address)
+{
+    const Z21Slave::railCom* RailComPtr = NULL;
+    railComHistory* HistoryPtr          = Find(Address);
+
+    if (HistoryPtr != NULL)
+    {
+        RailComPtr = &HistoryPtr->Latest;
+    }
+
+    return (RailComPtr);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21RailCom::Average(uint16_t Address, railComAverage* AveragePtr)
+{
+    bool Result                = false;
+    railComHistory* HistoryPtr = Find(Address);
+
+    if (HistoryPtr != NULL)
+    {
+        AveragePtr->Speed   = (uint8_t)((HistoryPtr->SpeedSum + (HistoryPtr->Samples / 2)) / HistoryPtr->Samples);
+        AveragePtr->Qos     = (uint8_t)((HistoryPtr->QosSum + (HistoryPtr->Samples / 2)) / HistoryPtr->Samples);
+        AveragePtr->Samples = HistoryPtr->Samples;
+        Result              = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+Z21RailCom::railComHistory* Z21RailCom::Find(uint16_t Address)
+{
+    uint8_t Index              = 0;
+    railComHistory* HistoryPtr = NULL;
+
+    while ((HistoryPtr == NULL) && (Index < Z21_RAILCOM_LOCS_MAX))
+    {
+        if ((m_Pool[Index].Used == true) && (m_Pool[Index].Latest.Address == Address))
+        {
+            HistoryPtr = &m_Pool[Index];
+        }
+        Index++;
+    }
+
+    return (HistoryPtr);
+}
+
+/***********************************************************************************************************************
+ */
+Z21RailCom::railComHistory* Z21RailCom::Allocate()
+{
+    uint8_t Index;
+    railComHistory* HistoryPtr;
+
+    if (m_NrOfFree > 0)
+    {
+        m_NrOfFree--;
+        HistoryPtr = &m_Pool[m_Free[m_NrOfFree]];
+    }
+    else
+    {
+        // Pool is full, reuse the locomotive which was not updated for the longest time.
+        HistoryPtr = &m_Pool[0];
+        for (Index = 1; Index < Z21_RAILCOM_LOCS_MAX; Index++)
+        {
+            if ((m_Sequence - m_Pool[Index].Sequence) > (m_Sequence - HistoryPtr->Sequence))
+            {
+                HistoryPtr = &m_Pool[Index];
+            }
+        }
+    }
+
+    memset(HistoryPtr, 0, sizeof(railComHistory));
+    HistoryPtr->Used = true;
+
+    return (HistoryPtr);
+}
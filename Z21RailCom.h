@@ -0,0 +1,104 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21RailCom.h
+ * @brief History of received RailCom data per locomotive with the latest and averaged speed and QoS.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_RAILCOM_H
+#define Z21_RAILCOM_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_RAILCOM_LOCS_MAX 8     //!< Number of locomotives in the pool.
+#define Z21_RAILCOM_HISTORY_SIZE 8 //!< Number of samples kept per locomotive.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21RailCom
+{
+public:
+    /**
+     * Structure with averaged RailCom data.
+     */
+    struct railComAverage
+    {
+        uint8_t Speed;
+        uint8_t Qos;
+        uint8_t Samples;
+    };
+
+    /**
+     * Constructor
+     */
+    Z21RailCom();
+
+    /**
+     * Remove all locomotives.
+     */
+    void Clear();
+
+    /**
+     * Add received RailCom data. When the pool is full the locomotive updated longest ago is replaced.
+     */
+    void Add(const Z21Slave::railCom* RailComPtr);
+
+    /**
+     * Remove a locomotive and return its memory to the pool.
+     */
+    void Remove(uint16_t Address);
+
+    /**
+     * Latest RailCom data of a locomotive, NULL when not present.
+     */
+    const Z21Slave::railCom* Latest(uint16_t Address);
+
+    /**
+     * Average speed and QoS of the samples in the history. Returns false when the locomotive is not present.
+     */
+    bool Average(uint16_t Address, railComAverage* AveragePtr);
+
+private:
+    /**
+     * Typedef struct for the history of one locomotive. The sums are kept up to date so an average does not need
+     * the samples.
+     */
+    typedef struct
+    {
+        Z21Slave::railCom Latest;
+        uint8_t Speed[Z21_RAILCOM_HISTORY_SIZE];
+        uint8_t Qos[Z21_RAILCOM_HISTORY_SIZE];
+        uint16_t SpeedSum;
+        uint16_t QosSum;
+        uint8_t Head;
+        uint8_t Samples;
+        uint32_t Sequence;
+        bool Used;
+    } railComHistory;
+
+    railComHistory m_Pool[Z21_RAILCOM_LOCS_MAX]; /* History memory. */
+    uint8_t m_Free[Z21_RAILCOM_LOCS_MAX];        /* Free pool entries. */
+    uint8_t m_NrOfFree;                          /* Number of free pool entries. */
+    uint32_t m_Sequence;                         /* Update counter for replacing the oldest entry. */
+
+    /**
+     * Find the history of a locomotive.
+     */
+    railComHistory* Find(uint16_t Address);
+
+    /**
+     * Take a history from the pool, or replace the oldest one.
+     */
+    railComHistory* Allocate();
+};
+
+#endif
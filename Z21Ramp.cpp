@@ -0,0 +1,283 @@
+/***********************************************************************************************************************
+   @file   Z21Ramp.cpp
+   @brief  Z21 locomotive acceleration and brake ramp implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Ramp.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21Ramp::Z21Ramp(Z21Slave* SlavePtr)
+{
+    m_SlavePtr   = SlavePtr;
+    m_UpdateTime = millis();
+    m_Next       = 0;
+    m_Budget     = 0;
+    memset(m_Locs, 0, sizeof(m_Locs));
+}
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+bool Z21Ramp::Set(const Z21Slave::locInfo* LocInfoPtr, uint16_t AccelerationMs, uint16_t BrakeMs)
+{
+    bool Result     = false;
+    uint8_t Index   = 0;
+    rampLoc* LocPtr = Find(LocInfoPtr->Address);
+
+    if (LocPtr == NULL)
+    {
+        while ((Index < Z21_RAMP_LOCS_MAX) && (m_Locs[Index].Used == true))
+        {
+            Index++;
+        }
+
+        if (Index < Z21_RAMP_LOCS_MAX)
+        {
+            LocPtr = &m_Locs[Index];
+        }
+    }
+
+    if ((LocPtr != NULL) && (LocInfoPtr->Steps != Z21Slave::locDecoderSpeedStepsUnknown))
+    {
+        switch (LocInfoPtr->Steps)
+        {
+        case Z21Slave::locDecoderSpeedSteps14: LocPtr->Maximum = (uint32_t)14 << 16; break;
+        case Z21Slave::locDecoderSpeedSteps28: LocPtr->Maximum = (uint32_t)28 << 16; break;
+        default: LocPtr->Maximum = (uint32_t)127 << 16; break;
+        }
+
+        LocPtr->Address         = LocInfoPtr->Address;
+        LocPtr->Steps           = LocInfoPtr->Steps;
+        LocPtr->Direction       = LocInfoPtr->Direction;
+        LocPtr->TargetDirection = LocInfoPtr->Direction;
+        LocPtr->Current         = (uint32_t)(LocInfoPtr->Speed) << 16;
+        if (LocPtr->Current > LocPtr->Maximum)
+        {
+            LocPtr->Current = LocPtr->Maximum;
+        }
+        LocPtr->Target = LocPtr->Current;
+
+        // Rate is the speed change per ms, a ramp time of 0 jumps to the target.
+        LocPtr->AccelerationMs   = AccelerationMs;
+        LocPtr->BrakeMs          = BrakeMs;
+        LocPtr->AccelerationRate = (AccelerationMs > 0) ? (LocPtr->Maximum / AccelerationMs) : 0;
+        LocPtr->BrakeRate        = (BrakeMs > 0) ? (LocPtr->Maximum / BrakeMs) : 0;
+
+        // The loc info is the state of the Z21, so nothing has to be transmitted yet.
+        LocPtr->SpeedTx     = SpeedTx(LocPtr);
+        LocPtr->DirectionTx = LocPtr->Direction;
+        LocPtr->Pending     = false;
+        LocPtr->Used        = true;
+        Result              = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Ramp::Remove(uint16_t Address)
+{
+    rampLoc* LocPtr = Find(Address);
+
+    if (LocPtr != NULL)
+    {
+        LocPtr->Used = false;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Ramp::Target(uint16_t Address, uint8_t Speed, Z21Slave::locDirection Direction)
+{
+    bool Result     = false;
+    rampLoc* LocPtr = Find(Address);
+
+    if (LocPtr != NULL)
+    {
+        LocPtr->Target = (uint32_t)(Speed) << 16;
+        if (LocPtr->Target > LocPtr->Maximum)
+        {
+            LocPtr->Target = LocPtr->Maximum;
+        }
+        LocPtr->TargetDirection = Direction;
+        Result                  = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Ramp::Speed(uint16_t Address)
+{
+    uint8_t Speed   = 0;
+    rampLoc* LocPtr = Find(Address);
+
+    if (LocPtr != NULL)
+    {
+        Speed = (uint8_t)(LocPtr->Current >> 16);
+    }
+
+    return (Speed);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Ramp::Update()
+{
+    uint8_t Index;
+    rampLoc* LocPtr;
+    uint32_t Now       = millis();
+    uint32_t ElapsedMs = Now - m_UpdateTime;
+
+    m_UpdateTime = Now;
+    m_Budget     = Z21_RAMP_FRAMES_PER_TICK;
+
+    for (Index = 0; Index < Z21_RAMP_LOCS_MAX; Index++)
+    {
+        LocPtr = &m_Locs[Index];
+        if (LocPtr->Used == true)
+        {
+            Advance(LocPtr, ElapsedMs);
+
+            // Only a change of the transmitted values requires a message, intermediate values are skipped when the
+            // budget is too small.
+            LocPtr->Pending = (SpeedTx(LocPtr) != LocPtr->SpeedTx) || (LocPtr->Direction != LocPtr->DirectionTx);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Ramp::Transmit()
+{
+    bool Result   = false;
+    uint8_t Count = 0;
+    rampLoc* LocPtr;
+    Z21Slave::locInfo LocInfo;
+
+    // Round robin so all locomotives get a turn when the budget is too small.
+    while ((Result == false) && (m_Budget > 0) && (Count < Z21_RAMP_LOCS_MAX))
+    {
+        LocPtr = &m_Locs[m_Next];
+        m_Next = (m_Next + 1) % Z21_RAMP_LOCS_MAX;
+        Count++;
+
+        if ((LocPtr->Used == true) && (LocPtr->Pending == true))
+        {
+            LocPtr->SpeedTx     = SpeedTx(LocPtr);
+            LocPtr->DirectionTx = LocPtr->Direction;
+            LocPtr->Pending     = false;
+
+            memset(&LocInfo, 0, sizeof(LocInfo));
+            LocInfo.Address   = LocPtr->Address;
+            LocInfo.Speed     = LocPtr->SpeedTx;
+            LocInfo.Steps     = LocPtr->Steps;
+            LocInfo.Direction = LocPtr->Direction;
+            m_SlavePtr->LanXSetLocoDrive(&LocInfo);
+
+            m_Budget--;
+            Result = true;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Ramp::rampLoc* Z21Ramp::Find(uint16_t Address)
+{
+    uint8_t Index   = 0;
+    rampLoc* LocPtr = NULL;
+
+    while ((LocPtr == NULL) && (Index < Z21_RAMP_LOCS_MAX))
+    {
+        if ((m_Locs[Index].Used == true) && (m_Locs[Index].Address == Address))
+        {
+            LocPtr = &m_Locs[Index];
+        }
+        Index++;
+    }
+
+    return (LocPtr);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Ramp::Advance(rampLoc* LocPtr, uint32_t ElapsedMs)
+{
+    uint32_t Step;
+    uint32_t Goal = LocPtr->Target;
+
+    // Reverse only at stop.
+    if (LocPtr->Direction != LocPtr->TargetDirection)
+    {
+        Goal = 0;
+    }
+
+    if (LocPtr->Current < Goal)
+    {
+        // A full ramp takes AccelerationMs, so a longer time always reaches the goal and the multiply can not overflow.
+        if (ElapsedMs >= LocPtr->AccelerationMs)
+        {
+            LocPtr->Current = Goal;
+        }
+        else
+        {
+            Step            = LocPtr->AccelerationRate * ElapsedMs;
+            LocPtr->Current = ((Goal - LocPtr->Current) > Step) ? (LocPtr->Current + Step) : Goal;
+        }
+    }
+    else if (LocPtr->Current > Goal)
+    {
+        if (ElapsedMs >= LocPtr->BrakeMs)
+        {
+            LocPtr->Current = Goal;
+        }
+        else
+        {
+            Step            = LocPtr->BrakeRate * ElapsedMs;
+            LocPtr->Current = ((LocPtr->Current - Goal) > Step) ? (LocPtr->Current - Step) : Goal;
+        }
+    }
+
+    if ((LocPtr->Current == 0) && (LocPtr->Direction != LocPtr->TargetDirection))
+    {
+        LocPtr->Direction = LocPtr->TargetDirection;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Ramp::SpeedTx(rampLoc* LocPtr)
+{
+    uint8_t Speed = (uint8_t)(LocPtr->Current >> 16);
+
+    // For 128 speed steps the speed is the DCC value where 1 is emergency stop, never pass it while ramping.
+    if ((LocPtr->Steps == Z21Slave::locDecoderSpeedSteps128) && (Speed == 1))
+    {
+        Speed = 0;
+    }
+
+    return (Speed);
+}
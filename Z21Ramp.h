@@ -0,0 +1,113 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21Ramp.h
+ * @brief Acceleration and brake ramps for several locomotives, composing drive messages only when the speed or
+ *        direction send to the Z21 changes.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_RAMP_H
+#define Z21_RAMP_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_RAMP_LOCS_MAX 8        //!< Maximum number of locomotives with a ramp.
+#define Z21_RAMP_FRAMES_PER_TICK 2 //!< Maximum number of drive messages per update.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21Ramp
+{
+public:
+    /**
+     * Constructor
+     */
+    Z21Ramp(Z21Slave* SlavePtr);
+
+    /**
+     * Add a locomotive or change its ramp. The actual speed, direction and speed steps are taken from the loc info.
+     * AccelerationMs and BrakeMs are the times between stop and maximum speed, 0 means no ramp.
+     */
+    bool Set(const Z21Slave::locInfo* LocInfoPtr, uint16_t AccelerationMs, uint16_t BrakeMs);
+
+    /**
+     * Remove a locomotive, the actual speed is kept.
+     */
+    void Remove(uint16_t Address);
+
+    /**
+     * Set the speed to ramp to. A direction change brakes to stop first.
+     */
+    bool Target(uint16_t Address, uint8_t Speed, Z21Slave::locDirection Direction);
+
+    /**
+     * Actual ramp speed of a locomotive.
+     */
+    uint8_t Speed(uint16_t Address);
+
+    /**
+     * Advance all ramps to the actual time and restart the message budget. Call this cyclic.
+     */
+    void Update();
+
+    /**
+     * Compose the next drive message. Returns false when no message is pending or the budget of this update is
+     * used. Transmit the composed message before calling this again.
+     */
+    bool Transmit();
+
+private:
+    /**
+     * Typedef struct for a locomotive ramp. Speeds are 16.16 fixed point in the speed of locInfo.
+     */
+    typedef struct
+    {
+        uint16_t Address;
+        Z21Slave::locDecoderSteps Steps;
+        Z21Slave::locDirection Direction;
+        Z21Slave::locDirection TargetDirection;
+        uint32_t Current;
+        uint32_t Target;
+        uint32_t Maximum;
+        uint32_t AccelerationRate;
+        uint32_t BrakeRate;
+        uint16_t AccelerationMs;
+        uint16_t BrakeMs;
+        uint8_t SpeedTx;
+        Z21Slave::locDirection DirectionTx;
+        bool Pending;
+        bool Used;
+    } rampLoc;
+
+    Z21Slave* m_SlavePtr;              /* Slave used for composing messages. */
+    rampLoc m_Locs[Z21_RAMP_LOCS_MAX]; /* Locomotive ramps. */
+    uint32_t m_UpdateTime;             /* Time of last update. */
+    uint8_t m_Next;                    /* Next locomotive to check for a pending message. */
+    uint8_t m_Budget;                  /* Messages left in this update. */
+
+    /**
+     * Find the ramp of a locomotive.
+     */
+    rampLoc* Find(uint16_t Address);
+
+    /**
+     * Move the speed towards the target.
+     */
+    void Advance(rampLoc* LocPtr, uint32_t ElapsedMs);
+
+    /**
+     * Speed as send to the Z21.
+     */
+    uint8_t SpeedTx(rampLoc* LocPtr);
+};
+
+#endif
@@ -0,0 +1,243 @@
+/***********************************************************************************************************************
+   @file   Z21Sequence.cpp
+   @brief  Z21 request sequencer implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Sequence.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21Sequence::Z21Sequence(Z21Slave* SlavePtr)
+{
+    m_SlavePtr = SlavePtr;
+    memset(&m_locInfo, 0, sizeof(m_locInfo));
+    m_locInfo.Steps = Z21Slave::locDecoderSpeedStepsUnknown;
+    Clear();
+}
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21Sequence::Clear()
+{
+    m_NrOfSteps    = 0;
+    m_Step         = 0;
+    m_Transmitted  = false;
+    m_TransmitTime = 0;
+    m_State        = stateIdle;
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Sequence::AddCvRead(uint16_t CvNumber, uint16_t TimeoutMs)
+{
+    return (AddStep(stepCvRead, CvNumber, 0, Z21Slave::locDirectionForward, TimeoutMs));
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Sequence::AddCvWrite(uint16_t CvNumber, uint8_t CvValue, uint16_t TimeoutMs)
+{
+    return (AddStep(stepCvWrite, CvNumber, CvValue, Z21Slave::locDirectionForward, TimeoutMs));
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Sequence::AddLocInfo(uint16_t Address, uint16_t TimeoutMs)
+{
+    return (AddStep(stepLocInfo, Address, 0, Z21Slave::locDirectionForward, TimeoutMs));
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Sequence::AddLocDrive(uint16_t Address, uint8_t Speed, Z21Slave::locDirection Direction)
+{
+    return (AddStep(stepLocDrive, Address, Speed, Direction, 0));
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Sequence::Start()
+{
+    m_Step        = 0;
+    m_Transmitted = false;
+
+    if (m_NrOfSteps > 0)
+    {
+        m_State = stateBusy;
+    }
+    else
+    {
+        m_State = stateDone;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+Z21Sequence::state Z21Sequence::Update()
+{
+    sequenceStep* StepPtr;
+    Z21Slave::locInfo LocDrive;
+
+    if (m_State == stateBusy)
+    {
+        StepPtr = &m_Steps[m_Step];
+
+        // Compose only when the previous message is taken, it would be overwritten otherwise.
+        if ((m_Transmitted == false) && (m_SlavePtr->TxDataPending() == false))
+        {
+            m_Transmitted  = true;
+            m_TransmitTime = millis();
+
+            switch (StepPtr->Type)
+            {
+            case stepCvRead: m_SlavePtr->LanCvRead(StepPtr->Number); break;
+            case stepCvWrite: m_SlavePtr->LanCvWrite(StepPtr->Number, StepPtr->Value); break;
+            case stepLocInfo: m_SlavePtr->LanXGetLocoInfo(StepPtr->Number); break;
+            case stepLocDrive:
+                if ((m_locInfo.Address == StepPtr->Number)
+                    && (m_locInfo.Steps != Z21Slave::locDecoderSpeedStepsUnknown))
+                {
+                    // Work on a copy, LanXSetLocoDrive limits and adjusts the speed.
+                    m_locInfo.Speed     = StepPtr->Value;
+                    m_locInfo.Direction = StepPtr->Direction;
+                    LocDrive            = m_locInfo;
+                    m_SlavePtr->LanXSetLocoDrive(&LocDrive);
+                    NextStep();
+                }
+                else
+                {
+                    m_State = stateFailed;
+                }
+                break;
+            }
+        }
+        else if ((m_Transmitted == true) && ((millis() - m_TransmitTime) >= StepPtr->TimeoutMs))
+        {
+            m_State = stateTimeout;
+        }
+    }
+
+    return (m_State);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Sequence::state Z21Sequence::Process(Z21Slave::dataType Type)
+{
+    sequenceStep* StepPtr;
+
+    if ((m_State == stateBusy) && (m_Transmitted == true))
+    {
+        StepPtr = &m_Steps[m_Step];
+
+        switch (Type)
+        {
+        case Z21Slave::programmingCvResult:
+            if (((StepPtr->Type == stepCvRead) || (StepPtr->Type == stepCvWrite))
+                && (m_SlavePtr->LanXCvResult()->Number == StepPtr->Number))
+            {
+                StepPtr->Value = m_SlavePtr->LanXCvResult()->Value;
+                NextStep();
+            }
+            break;
+        case Z21Slave::programmingCvNackSc:
+            if ((StepPtr->Type == stepCvRead) || (StepPtr->Type == stepCvWrite))
+            {
+                m_State = stateFailed;
+            }
+            break;
+        case Z21Slave::locinfo:
+            if ((StepPtr->Type == stepLocInfo) && (m_SlavePtr->LanXLocoInfo()->Address == StepPtr->Number))
+            {
+                m_locInfo = *m_SlavePtr->LanXLocoInfo();
+                NextStep();
+            }
+            break;
+        default: break;
+        }
+    }
+
+    return (m_State);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Sequence::state Z21Sequence::GetState() { return (m_State); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Sequence::GetStep() { return (m_Step); }
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Sequence::CvValue(uint8_t Step)
+{
+    uint8_t Value = 0;
+
+    if (Step < m_NrOfSteps)
+    {
+        Value = m_Steps[Step].Value;
+    }
+
+    return (Value);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::locInfo* Z21Sequence::LocInfo() { return (&m_locInfo); }
+
+/***********************************************************************************************************************
+ */
+bool Z21Sequence::AddStep(
+    stepType Type, uint16_t Number, uint8_t Value, Z21Slave::locDirection Direction, uint16_t TimeoutMs)
+{
+    bool Result = false;
+
+    // Steps can only be added when the sequence is not running.
+    if ((m_NrOfSteps < Z21_SEQUENCE_STEPS_MAX) && (m_State != stateBusy))
+    {
+        m_Steps[m_NrOfSteps].Type      = Type;
+        m_Steps[m_NrOfSteps].Number    = Number;
+        m_Steps[m_NrOfSteps].Value     = Value;
+        m_Steps[m_NrOfSteps].Direction = Direction;
+        m_Steps[m_NrOfSteps].TimeoutMs = TimeoutMs;
+        m_NrOfSteps++;
+        Result = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Sequence::NextStep()
+{
+    m_Transmitted = false;
+
+    if ((m_Step + 1) < m_NrOfSteps)
+    {
+        m_Step++;
+    }
+    else
+    {
+        m_State = stateDone;
+    }
+}
@@ -0,0 +1,155 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21Sequence.h
+ * @brief Sequencer for Z21 requests which must wait for the response of the previous request, like reading
+ *        several CV's or reading loc info before changing the drive settings. Only one sequence may be active per
+ *        Z21Slave: the sequences share the transmit buffer and a CV result can not be assigned to a sequence.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_SEQUENCE_H
+#define Z21_SEQUENCE_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_SEQUENCE_STEPS_MAX 8 //!< Maximum number of steps in a sequence.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21Sequence
+{
+public:
+    /**
+     * Type of a sequence step.
+     */
+    enum stepType
+    {
+        stepCvRead = 0,
+        stepCvWrite,
+        stepLocInfo,
+        stepLocDrive,
+    };
+
+    /**
+     * State of the sequence.
+     */
+    enum state
+    {
+        stateIdle = 0,
+        stateBusy,
+        stateDone,
+        stateTimeout,
+        stateFailed,
+    };
+
+    /**
+     * Constructor
+     */
+    Z21Sequence(Z21Slave* SlavePtr);
+
+    /**
+     * Remove all steps and go to idle.
+     */
+    void Clear();
+
+    /**
+     * Add a CV read step, the step is done when the CV result is received.
+     */
+    bool AddCvRead(uint16_t CvNumber, uint16_t TimeoutMs);
+
+    /**
+     * Add a CV write step, the step is done when the CV result is received.
+     */
+    bool AddCvWrite(uint16_t CvNumber, uint8_t CvValue, uint16_t TimeoutMs);
+
+    /**
+     * Add a loc info step, the step is done when the loc info of the address is received.
+     */
+    bool AddLocInfo(uint16_t Address, uint16_t TimeoutMs);
+
+    /**
+     * Add a loc drive step, the step is done when the message is transmitted. The speed steps are taken from the
+     * loc info of a previous loc info step for the same address, the speed is limited to the maximum of the speed
+     * steps.
+     */
+    bool AddLocDrive(uint16_t Address, uint8_t Speed, Z21Slave::locDirection Direction);
+
+    /**
+     * Start processing the steps.
+     */
+    void Start();
+
+    /**
+     * Compose the next step once the transmit buffer is free and check the timeout of the active step. Call this
+     * cyclic before checking Z21Slave::txDataPresent.
+     */
+    state Update();
+
+    /**
+     * Handle the result of Z21Slave::ProcesDataRx.
+     */
+    state Process(Z21Slave::dataType Type);
+
+    /**
+     * Actual state of the sequence.
+     */
+    state GetState();
+
+    /**
+     * Index of the active step, or the failed step after a timeout or failure.
+     */
+    uint8_t GetStep();
+
+    /**
+     * Received CV value of a CV read or CV write step.
+     */
+    uint8_t CvValue(uint8_t Step);
+
+    /**
+     * Loc info of the last finished loc info step.
+     */
+    Z21Slave::locInfo* LocInfo();
+
+private:
+    /**
+     * Typedef struct for a step.
+     */
+    typedef struct
+    {
+        stepType Type;
+        uint16_t Number;
+        uint8_t Value;
+        Z21Slave::locDirection Direction;
+        uint16_t TimeoutMs;
+    } sequenceStep;
+
+    Z21Slave* m_SlavePtr;                         /* Slave used for composing and decoding messages. */
+    sequenceStep m_Steps[Z21_SEQUENCE_STEPS_MAX]; /* Steps of the sequence. */
+    Z21Slave::locInfo m_locInfo;                  /* Result of the last loc info step. */
+    uint8_t m_NrOfSteps;                          /* Number of steps added. */
+    uint8_t m_Step;                               /* Active step. */
+    bool m_Transmitted;                           /* Active step is transmitted, waiting for response. */
+    uint32_t m_TransmitTime;                      /* Time the active step was transmitted. */
+    state m_State;                                /* State of the sequence. */
+
+    /**
+     * Add a step.
+     */
+    bool AddStep(stepType Type, uint16_t Number, uint8_t Value, Z21Slave::locDirection Direction, uint16_t TimeoutMs);
+
+    /**
+     * Finish the active step and continue with the next one.
+     */
+    void NextStep();
+};
+
+#endif
@@ -17,13 +17,39 @@
    D A T A   D E C L A R A T I O N S (exported, local)
  **********************************************************************************************************************/
 
+/* Bits of the LanConnect responses, the loc info responses follow the last bit. */
+static const uint16_t ConnectSerialNumber = 0x0001;
+static const uint16_t ConnectHwInfo       = 0x0002;
+static const uint16_t ConnectFirmware     = 0x0004;
+static const uint16_t ConnectVersion      = 0x0008;
+static const uint16_t ConnectStatus       = 0x0010;
+static const uint8_t ConnectLocInfoShift  = 5;
+
 /***********************************************************************************************************************
    C O N S T R U C T O R
  **********************************************************************************************************************/
 
 Z21Slave::Z21Slave()
 {
-    m_txDataPresent = false;
+    m_txDataPresent    = false;
+    m_txLastTime       = 0;
+    m_rxLastTime       = 0;
+    m_rxReceived       = false;
+    m_broadcastFlags   = 0;
+    m_reSubscribe      = false;
+    m_txLength         = 0;
+    m_txAppend         = false;
+    m_connectPending   = 0;
+    m_connectStartTime = 0;
+    m_connectTime      = 0;
+    m_connectFailed    = false;
+    memset(&m_versionData, 0, sizeof(m_versionData));
+    memset(&m_railCom, 0, sizeof(m_railCom));
+    memset(&m_systemState, 0, sizeof(m_systemState));
+    memset(&m_locoNetDispatch, 0, sizeof(m_locoNetDispatch));
+    memset(&m_locoNetDetector, 0, sizeof(m_locoNetDetector));
+    memset(m_connectAddress, 0, sizeof(m_connectAddress));
+    memset(m_locInfoCache, 0, sizeof(m_locInfoCache));
     memset(m_BufferTx, 0, Z21_SLAVE_BUFFER_TX_SIZE);
 }
 
@@ -34,65 +60,53 @@ Z21Slave::Z21Slave()
 /***********************************************************************************************************************
  */
 Z21Slave::dataType Z21Slave::ProcesDataRx(const uint8_t* DataRxPtr, const uint16_t DataRxLength)
+{
+    uint16_t Offset = 0;
+
+    return (ProcesDataRx(DataRxPtr, DataRxLength, &Offset));
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::ProcesDataRx(const uint8_t* DataRxPtr, const uint16_t DataRxLength, uint16_t* OffsetPtr)
 {
     dataType returnValue = none;
+    uint32_t Now;
+    uint8_t DataLen = 0;
 
-    // See Anhang A  Befehlsbersicht for the case values.
-    switch (DataRxPtr[2])
+    if (*OffsetPtr < DataRxLength)
     {
-    case 0x10:
-        // LAN_GET_SERIAL_NUMBER
-        break;
-    case 0x1A:
-        // LAN_GET_HWINFO
-        break;
-    case 0x30:
-        // LAN_LOGOFF
-        break;
-    case 0x40:
-        // Run through list of supported commands.
-        returnValue = DecodeRxMessage(DataRxPtr, DataRxLength);
-        break;
-    case 0x50:
-        // LAN_SET_BROADCASTFLAGS
-        break;
-    case 0x51:
-        // LAN_GET_BROADCASTFLAGS
-        break;
-    case 0x60:
-        // LAN_GET_LOCOMODE
-        break;
-    case 0x61:
-        // LAN_SET_LOCOMODE
-        break;
-    case 0x70:
-        // LAN_GET_TURNOUTMODE
-        break;
-    case 0x71:
-        // LAN_SET_TURNOUTMODE
-        break;
-    case 0x81:
-        // LAN_RMBUS_GETDATA
-        break;
-    case 0x82:
-        // LAN_RMBUS_PROGRAMMODULE
-        break;
-    case 0x85:
-        // LAN_SYSTEMSTATE_GETDATA
-        break;
-    case 0x89:
-        // LAN_RAILCOM_GETDATA
-        break;
-    case 0xA2:
-        // LAN_LOCONET_FROM_LAN
-        break;
-    case 0xA3:
-        // LAN_LOCONET_DISPATCH_ADDR
-        break;
-    case 0xA4:
-        // LAN_LOCONET_DETECTOR
-        break;
-    default: returnValue = none; break;
+        DataLen = Z21Message::FramedLength(&DataRxPtr[*OffsetPtr], DataRxLength - *OffsetPtr);
+
+        if (DataLen != 0)
+        {
+            if (*OffsetPtr == 0)
+            {
+                // A message after a long silence means the Z21 was gone and has forgotten the broadcast flags.
+                Now = millis();
+                if ((m_rxReceived == true) && ((Now - m_rxLastTime) >= Z21_SLAVE_LINK_LOST_TIME))
+                {
+                    m_reSubscribe = true;
+                }
+                m_rxReceived = true;
+                m_rxLastTime = Now;
+            }
+
+            // The view of the message type validates the message, a message which is not valid returns none.
+            returnValue = DecodeMessage(&DataRxPtr[*OffsetPtr], DataLen);
+
+            if (m_connectPending != 0)
+            {
+                UpdateConnect(returnValue);
+            }
+
+            *OffsetPtr += DataLen;
+        }
+        else
+        {
+            // A truncated message hides where the next one starts, skip the rest of the datagram.
+            *OffsetPtr = DataRxLength;
+        }
     }
 
     return (returnValue);
@@ -102,6 +116,10 @@ Z21Slave::dataType Z21Slave::ProcesDataRx(const uint8_t* DataRxPtr, const uint16
  */
 uint8_t* Z21Slave::GetDataTx() { return (m_BufferTx); }
 
+/***********************************************************************************************************************
+ */
+uint16_t Z21Slave::GetDataTxLength() { return (m_txLength); }
+
 /***********************************************************************************************************************
  */
 bool Z21Slave::txDataPresent()
@@ -111,6 +129,107 @@ bool Z21Slave::txDataPresent()
     return (Result);
 }
 
+/***********************************************************************************************************************
+ */
+bool Z21Slave::TxDataPending() { return (m_txDataPresent); }
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanConnect(uint32_t Flags, const uint16_t* AddressPtr, uint8_t NrOfAddresses)
+{
+    uint8_t Index;
+
+    if (NrOfAddresses > Z21_SLAVE_CONNECT_LOCS_MAX)
+    {
+        NrOfAddresses = Z21_SLAVE_CONNECT_LOCS_MAX;
+    }
+
+    m_txLength       = 0;
+    m_txAppend       = true;
+    m_connectPending = ConnectSerialNumber | ConnectHwInfo | ConnectFirmware | ConnectVersion | ConnectStatus;
+
+    LanGetSerialNumber();
+    LanGetHwInfo();
+    LanXGetFirmwareVersion();
+    LanXGetVersion();
+    LanGetStatus();
+    LanSetBroadCastFlags(Flags);
+
+    for (Index = 0; Index < NrOfAddresses; Index++)
+    {
+        m_connectAddress[Index] = AddressPtr[Index];
+        m_connectPending |= (uint16_t)(1 << (ConnectLocInfoShift + Index));
+        LanXGetLocoInfo(AddressPtr[Index]);
+    }
+
+    m_txAppend         = false;
+    m_connectStartTime = millis();
+    m_connectTime      = 0;
+    m_connectFailed    = false;
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Slave::ConnectReady()
+{
+    CheckConnectTimeout();
+    return ((m_connectPending == 0) && (m_connectTime != 0));
+}
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21Slave::ConnectTime() { return (m_connectTime); }
+
+/***********************************************************************************************************************
+ */
+bool Z21Slave::ConnectFailed()
+{
+    CheckConnectTimeout();
+    return (m_connectFailed);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Slave::KeepAlive()
+{
+    bool Result  = false;
+    uint32_t Now = millis();
+
+    if (TxDataPending() == false)
+    {
+        if ((m_broadcastFlags != 0) && ((m_reSubscribe == true) || ((Now - m_txLastTime) >= Z21_SLAVE_LINK_LOST_TIME)))
+        {
+            // Z21 dropped this client, subscribe again so broadcasts are received.
+            LanSetBroadCastFlags(m_broadcastFlags);
+            Result = true;
+        }
+        else if ((Now - m_txLastTime) >= Z21_SLAVE_KEEPALIVE_TIME)
+        {
+            // Nothing transmitted for a while, the serial number request is the smallest message with a response.
+            LanGetSerialNumber();
+            Result = true;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanGetSerialNumber() { ComposeTxMessage(0x10, NULL, 0, false); }
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanXGetVersion()
+{
+    uint8_t DataTx[2];
+
+    DataTx[0] = 0x21;
+    DataTx[1] = 0x21;
+
+    ComposeTxMessage(0x40, DataTx, 2, true);
+}
+
 /***********************************************************************************************************************
  */
 void Z21Slave::LanGetStatus()
@@ -158,6 +277,18 @@ void Z21Slave::LanSetStop()
     ComposeTxMessage(0x40, DataTx, 1, true);
 }
 
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanXGetFirmwareVersion()
+{
+    uint8_t DataTx[2];
+
+    DataTx[0] = 0xF1;
+    DataTx[1] = 0x0A;
+
+    ComposeTxMessage(0x40, DataTx, 2, true);
+}
+
 /***********************************************************************************************************************
  */
 void Z21Slave::LanSetBroadCastFlags(uint32_t Flags)
@@ -169,9 +300,20 @@ void Z21Slave::LanSetBroadCastFlags(uint32_t Flags)
     DataTx[2] = (Flags >> 16) & 0xFF;
     DataTx[3] = (Flags >> 24) & 0xFF;
 
-    ComposeTxMessage(0x50, DataTx, 4, true);
+    m_broadcastFlags = Flags;
+    m_reSubscribe    = false;
+
+    ComposeTxMessage(0x50, DataTx, 4, false);
 }
 
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanGetHwInfo() { ComposeTxMessage(0x1A, NULL, 0, false); }
+
+/***********************************************************************************************************************
+ */
+Z21Slave::versionData* Z21Slave::LanVersionData() { return (&m_versionData); }
+
 /***********************************************************************************************************************
  */
 void Z21Slave::LanXGetLocoInfo(uint16_t Address)
@@ -214,6 +356,10 @@ void Z21Slave::LanXSetLocoDrive(locInfo* LocInfoPtr)
     switch (LocInfoPtr->Steps)
     {
     case locDecoderSpeedSteps14:
+        if (LocInfoPtr->Speed > 14)
+        {
+            LocInfoPtr->Speed = 14;
+        }
         if (LocInfoPtr->Speed > 0)
         {
             LocInfoPtr->Speed++;
@@ -222,12 +368,20 @@ void Z21Slave::LanXSetLocoDrive(locInfo* LocInfoPtr)
         DataTx[4] |= LocInfoPtr->Speed;
         break;
     case locDecoderSpeedSteps28:
+        if (LocInfoPtr->Speed > 28)
+        {
+            LocInfoPtr->Speed = 28;
+        }
         DataTx[1] = 0x12;
         DataTx[4] |= SpeedStep28TableToDcc[LocInfoPtr->Speed];
         break;
     case locDecoderSpeedSteps128:
+        if (LocInfoPtr->Speed > 127)
+        {
+            LocInfoPtr->Speed = 127;
+        }
         DataTx[1] = 0x13;
-        DataTx[4] |= (LocInfoPtr->Speed & 0x7F);
+        DataTx[4] |= LocInfoPtr->Speed;
         break;
     case locDecoderSpeedStepsUnknown: break;
     }
@@ -267,6 +421,10 @@ void Z21Slave::LanXSetLocoFunction(uint16_t Address, uint8_t Function, functionS
  */
 Z21Slave::locInfo* Z21Slave::LanXLocoInfo() { return (&m_locInfo); }
 
+/***********************************************************************************************************************
+ */
+Z21Slave::locInfoChanged* Z21Slave::LanXLocoInfoChanged() { return (&m_locInfoChanged); }
+
 /***********************************************************************************************************************
  */
 Z21Slave::cvData* Z21Slave::LanXCvResult() { return (&m_CvData); }
@@ -275,6 +433,85 @@ Z21Slave::cvData* Z21Slave::LanXCvResult() { return (&m_CvData); }
  */
 Z21Slave::locLibData* Z21Slave::LanXLocLibData() { return (&m_locLibData); }
 
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanRailComGetData(uint16_t Address)
+{
+    uint8_t DataTx[3];
+
+    DataTx[0] = 0x01;
+    DataTx[1] = (Address)&0xFF;
+    DataTx[2] = (Address >> 8) & 0xFF;
+
+    ComposeTxMessage(0x89, DataTx, 3, false);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::railCom* Z21Slave::LanRailComData() { return (&m_railCom); }
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanSystemStateGetData() { ComposeTxMessage(0x85, NULL, 0, false); }
+
+/***********************************************************************************************************************
+ */
+Z21Slave::systemState* Z21Slave::LanSystemStateData() { return (&m_systemState); }
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanLocoNetFromLan(const uint8_t* LocoNetPtr, uint8_t Length)
+{
+    uint8_t* MessagePtr;
+
+    if (Length >= 2)
+    {
+        if (ComposeTxMessage(0xA2, LocoNetPtr, Length, false) == true)
+        {
+            // The message is the last one in the transmit buffer, set its checksum in place.
+            MessagePtr             = &m_BufferTx[m_txLength - Length];
+            MessagePtr[Length - 1] = Z21LocoNetMessage::Checksum(MessagePtr, Length);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanLocoNetDispatchAddr(uint16_t Address)
+{
+    uint8_t DataTx[2];
+
+    DataTx[0] = (Address)&0xFF;
+    DataTx[1] = (Address >> 8) & 0xFF;
+
+    ComposeTxMessage(0xA3, DataTx, 2, false);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::LanLocoNetDetector(uint8_t Type, uint16_t ReportAddress)
+{
+    uint8_t DataTx[3];
+
+    DataTx[0] = Type;
+    DataTx[1] = (ReportAddress)&0xFF;
+    DataTx[2] = (ReportAddress >> 8) & 0xFF;
+
+    ComposeTxMessage(0xA4, DataTx, 3, false);
+}
+
+/***********************************************************************************************************************
+ */
+Z21LocoNetMessage* Z21Slave::LanLocoNetMessage() { return (&m_locoNetMessage); }
+
+/***********************************************************************************************************************
+ */
+Z21Slave::locoNetDispatchData* Z21Slave::LanLocoNetDispatchData() { return (&m_locoNetDispatch); }
+
+/***********************************************************************************************************************
+ */
+Z21Slave::locoNetDetectorData* Z21Slave::LanLocoNetDetectorData() { return (&m_locoNetDetector); }
+
 /***********************************************************************************************************************
  */
 void Z21Slave::LanXLocLibDataTransmit(uint16_t Address, uint8_t Index, uint8_t NrOfLocs, char* NamePtr)
@@ -375,123 +612,307 @@ void Z21Slave::LanXCvPomWriteByte(uint16_t Address, uint16_t CvNumber, uint8_t C
 
 /***********************************************************************************************************************
  */
-void Z21Slave::ComposeTxMessage(uint8_t Header, uint8_t* TxDataPtr, uint16_t TxLength, bool ChecksumCalc)
+bool Z21Slave::ComposeTxMessage(uint8_t Header, const uint8_t* TxDataPtr, uint16_t TxLength, bool ChecksumCalc)
 {
+    bool Result      = false;
     uint16_t Index   = 0;
     uint8_t Checksum = 0;
+    uint16_t Offset  = 0;
+    uint16_t Length;
+    uint8_t* BufferPtr;
 
-    // Fill DataLen and Header.
     // DataLen is header length + data length + XOR-Byte (if XOR byte is required).
     if (ChecksumCalc == true)
     {
-        m_BufferTx[0] = 4 + TxLength + 1;
+        Length = 4 + TxLength + 1;
     }
     else
     {
-        m_BufferTx[0] = 4 + TxLength;
+        Length = 4 + TxLength;
     }
 
-    m_BufferTx[1] = 0x00;
-    m_BufferTx[2] = Header;
-    m_BufferTx[3] = 0x00;
-
-    // Copy data to be transmitted.
-    memcpy(&m_BufferTx[4], TxDataPtr, TxLength);
+    // Connect messages are placed behind each other so they are transmitted in one datagram.
+    if (m_txAppend == true)
+    {
+        Offset = m_txLength;
+    }
 
-    // Calculate XOR byte of the data.
-    if (ChecksumCalc == true)
+    if ((Offset + Length) <= Z21_SLAVE_BUFFER_TX_SIZE)
     {
-        for (Index = 0; Index < TxLength; Index++)
+        BufferPtr = &m_BufferTx[Offset];
+
+        // Fill DataLen and Header.
+        BufferPtr[0] = Length;
+        BufferPtr[1] = 0x00;
+        BufferPtr[2] = Header;
+        BufferPtr[3] = 0x00;
+
+        // Copy data to be transmitted.
+        if (TxLength > 0)
         {
-            if (Index == 0)
-            {
-                Checksum = TxDataPtr[Index];
-            }
-            else
+            memcpy(&BufferPtr[4], TxDataPtr, TxLength);
+        }
+
+        // Calculate XOR byte of the data.
+        if (ChecksumCalc == true)
+        {
+            for (Index = 0; Index < TxLength; Index++)
             {
-                Checksum ^= TxDataPtr[Index];
+                if (Index == 0)
+                {
+                    Checksum = TxDataPtr[Index];
+                }
+                else
+                {
+                    Checksum ^= TxDataPtr[Index];
+                }
             }
+
+            // Store Xor byte
+            BufferPtr[4 + TxLength] = Checksum;
         }
 
-        // Store Xor byte
-        m_BufferTx[4 + TxLength] = Checksum;
+        m_txLength      = Offset + Length;
+        m_txDataPresent = true;
+        m_txLastTime    = millis();
+        Result          = true;
     }
 
-    m_txDataPresent = true;
+    return (Result);
 }
 
 /***********************************************************************************************************************
+ * DataLen, header and for X-Bus messages X-Header and DB0 are checked by Z21Message, the decoders are called with
+ * the minimum length of the bytes they read.
  */
-Z21Slave::dataType Z21Slave::DecodeRxMessage(const uint8_t* RxData, uint16_t RxLength)
+Z21Slave::dataType Z21Slave::DecodeMessage(const uint8_t* DataPtr, uint8_t DataLen)
 {
-    (void)RxLength;
     Z21Slave::dataType dataReturn = none;
 
-    if (RxData[5] == 0xF1)
+    // See Anhang A  Befehlsbersicht for the case values.
+    switch (DataPtr[2])
+    {
+    case 0x10:
+        // LAN_GET_SERIAL_NUMBER
+        dataReturn = GetSerialNumber(DataPtr, DataLen);
+        break;
+    case 0x1A:
+        // LAN_GET_HWINFO
+        dataReturn = GetHwInfo(DataPtr, DataLen);
+        break;
+    case 0x30:
+        // LAN_LOGOFF
+        break;
+    case 0x40:
+        // Run through list of supported commands.
+        dataReturn = DecodeXMessage(DataPtr, DataLen);
+        break;
+    case 0x50:
+        // LAN_SET_BROADCASTFLAGS
+        break;
+    case 0x51:
+        // LAN_GET_BROADCASTFLAGS
+        break;
+    case 0x60:
+        // LAN_GET_LOCOMODE
+        break;
+    case 0x61:
+        // LAN_SET_LOCOMODE
+        break;
+    case 0x70:
+        // LAN_GET_TURNOUTMODE
+        break;
+    case 0x71:
+        // LAN_SET_TURNOUTMODE
+        break;
+    case 0x81:
+        // LAN_RMBUS_GETDATA
+        break;
+    case 0x82:
+        // LAN_RMBUS_PROGRAMMODULE
+        break;
+    case 0x84:
+        // LAN_SYSTEMSTATE_DATACHANGED
+        dataReturn = GetSystemState(DataPtr, DataLen);
+        break;
+    case 0x85:
+        // LAN_SYSTEMSTATE_GETDATA
+        break;
+    case 0x88:
+        // LAN_RAILCOM_DATACHANGED
+        dataReturn = GetRailComData(DataPtr, DataLen);
+        break;
+    case 0x89:
+        // LAN_RAILCOM_GETDATA
+        break;
+    case 0xA0:
+        // LAN_LOCONET_Z21_RX
+        dataReturn = GetLocoNetMessage(DataPtr, DataLen, locoNetRx);
+        break;
+    case 0xA1:
+        // LAN_LOCONET_Z21_TX
+        dataReturn = GetLocoNetMessage(DataPtr, DataLen, locoNetTx);
+        break;
+    case 0xA2:
+        // LAN_LOCONET_FROM_LAN
+        dataReturn = GetLocoNetMessage(DataPtr, DataLen, locoNetFromLan);
+        break;
+    case 0xA3:
+        // LAN_LOCONET_DISPATCH_ADDR
+        dataReturn = GetLocoNetDispatch(DataPtr, DataLen);
+        break;
+    case 0xA4:
+        // LAN_LOCONET_DETECTOR
+        dataReturn = GetLocoNetDetector(DataPtr, DataLen);
+        break;
+    default: dataReturn = none; break;
+    }
+
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ * X-Header and DB0 select the view, the view checks the length and XOR byte.
+ */
+Z21Slave::dataType Z21Slave::DecodeXMessage(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+
+    if (DataLen < 6)
     {
-        if ((RxData[4] >= 0xE5) && (RxData[4] <= 0xEF))
+        // Too short for X-Header and XOR byte.
+    }
+    else if (DataPtr[5] == 0xF1)
+    {
+        if ((DataPtr[4] >= 0xE5) && (DataPtr[4] <= 0xEF))
         {
             /* Received loc library data, see
              * https://www.open4me.de/index.php/2017/06/zz21-wlan-maus-lok-bibliothek-befehle/  */
-            dataReturn = ProcessLocLibraryData(RxData);
+            dataReturn = ProcessLocLibraryData(DataPtr, DataLen);
         }
     }
     else
     {
-        switch (RxData[4])
+        switch (DataPtr[4])
         {
-        case 0x61: dataReturn = Status(RxData); break;
-        case 0x62: dataReturn = TrackPower(RxData); break;
-        case 0x63: dataReturn = unknown; break;
-        case 0x64: dataReturn = GetCVData(RxData); break;
-        case 0xF3: dataReturn = unknown; break;
-        case 0xEF: dataReturn = ProcessGetLocInfo(RxData); break;
-        case 0x81: dataReturn = emergencyStop; break;
+        case 0x61: dataReturn = Status(DataPtr, DataLen); break;
+        case 0x62: dataReturn = TrackPower(DataPtr, DataLen); break;
+        case 0x63:
+            if (DataPtr[5] == 0x21)
+            {
+                dataReturn = GetVersion(DataPtr, DataLen);
+            }
+            else
+            {
+                dataReturn = XMessageType(DataPtr, DataLen, unknown);
+            }
+            break;
+        case 0x64: dataReturn = GetCVData(DataPtr, DataLen); break;
+        case 0xF3:
+            if (DataPtr[5] == 0x0A)
+            {
+                dataReturn = GetFirmwareInfo(DataPtr, DataLen);
+            }
+            else
+            {
+                dataReturn = XMessageType(DataPtr, DataLen, unknown);
+            }
+            break;
+        case 0xEF: dataReturn = ProcessGetLocInfo(DataPtr, DataLen); break;
+        case 0x81: dataReturn = XMessageType(DataPtr, DataLen, emergencyStop); break;
         }
     }
 
     return (dataReturn);
 }
 
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::XMessageType(const uint8_t* DataPtr, uint8_t DataLen, dataType Type)
+{
+    Z21Message Message(DataPtr, DataLen);
+
+    return ((Message.Valid() == true) ? Type : none);
+}
+
 /***********************************************************************************************************************
  * Decode the library data.
  */
-Z21Slave::dataType Z21Slave::ProcessLocLibraryData(const uint8_t* RxData)
+Z21Slave::dataType Z21Slave::ProcessLocLibraryData(const uint8_t* DataPtr, uint8_t DataLen)
 {
-    uint8_t NameLength;
+    Z21Slave::dataType dataReturn = none;
+    Z21XLocLibMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
+    {
+        m_locLibData.Address = Message.Address();
+        m_locLibData.Actual  = Message.Actual();
+        m_locLibData.Total   = Message.Total();
+
+        memset(m_locLibData.NameStr, '\0', sizeof(m_locLibData.NameStr));
+        memcpy(m_locLibData.NameStr, Message.Name(), Message.NameLength());
+
+        dataReturn = locLibraryData;
+    }
 
-    m_locLibData.Address = (uint16_t)(RxData[6]) << 8;
-    m_locLibData.Address |= RxData[7];
-    m_locLibData.Actual = RxData[8];
-    m_locLibData.Total  = RxData[9];
+    return (dataReturn);
+}
 
-    memset(m_locLibData.NameStr, '\0', sizeof(m_locLibData.NameStr));
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::Status(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21XBroadcastMessage Message(DataPtr, DataLen);
 
-    NameLength = RxData[4] - 0xE5;
-    if (NameLength > 0)
+    if (Message.Valid() == true)
     {
-        if (NameLength > 10)
+        switch (Message.Db0())
         {
-            NameLength = 10;
+        case 0x00: dataReturn = trackPowerOff; break;
+        case 0x01: dataReturn = trackPowerOn; break;
+        case 0x02: dataReturn = programmingMode; break;
+        case 0x13: dataReturn = programmingCvNackSc; break;
+        default: dataReturn = unknown; break;
         }
-        memcpy(m_locLibData.NameStr, &RxData[10], NameLength);
     }
 
-    return (locLibraryData);
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::TrackPower(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21XStatusChangedMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
+    {
+        switch (Message.CentralState())
+        {
+        case 0x01: dataReturn = emergencyStop; break;
+        case 0x00: dataReturn = trackPowerOn; break;
+        case 0x20: dataReturn = programmingMode; break;
+        default: dataReturn = trackPowerOff; break;
+        }
+    }
+    return (dataReturn);
 }
 
 /***********************************************************************************************************************
  */
-Z21Slave::dataType Z21Slave::Status(const uint8_t* RxData)
+Z21Slave::dataType Z21Slave::GetCVData(const uint8_t* DataPtr, uint8_t DataLen)
 {
     Z21Slave::dataType dataReturn = none;
-    switch (RxData[5])
+    Z21XCvResultMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
     {
-    case 0x00: dataReturn = trackPowerOff; break;
-    case 0x01: dataReturn = trackPowerOn; break;
-    case 0x02: dataReturn = programmingMode; break;
-    case 0x13: dataReturn = programmingCvNackSc; break;
-    default: dataReturn = unknown; break;
+        m_CvData.Number = Message.CvAddress() + 1;
+        m_CvData.Value  = Message.CvValue();
+
+        dataReturn = programmingCvResult;
     }
 
     return (dataReturn);
@@ -499,101 +920,289 @@ Z21Slave::dataType Z21Slave::Status(const uint8_t* RxData)
 
 /***********************************************************************************************************************
  */
-Z21Slave::dataType Z21Slave::TrackPower(const uint8_t* RxData)
+Z21Slave::dataType Z21Slave::GetFirmwareInfo(const uint8_t* DataPtr, uint8_t DataLen)
 {
     Z21Slave::dataType dataReturn = none;
+    Z21XFirmwareVersionMessage Message(DataPtr, DataLen);
 
-    switch (RxData[6])
+    if (Message.Valid() == true)
     {
-    case 0x01: dataReturn = emergencyStop; break;
-    case 0x00: dataReturn = trackPowerOn; break;
-    case 0x20: dataReturn = programmingMode; break;
-    default: dataReturn = trackPowerOff; break;
+        m_versionData.FirmwareMajor = Message.Major();
+        m_versionData.FirmwareMinor = Message.Minor();
+
+        dataReturn = fwVersionInfoResponse;
     }
+
     return (dataReturn);
 }
 
 /***********************************************************************************************************************
  */
-Z21Slave::dataType Z21Slave::GetCVData(const uint8_t* RxData)
+Z21Slave::dataType Z21Slave::GetVersion(const uint8_t* DataPtr, uint8_t DataLen)
 {
-    m_CvData.Number = (uint16_t)(RxData[6]) << 8 | (uint16_t)(RxData[7]);
-    m_CvData.Number++;
-    m_CvData.Value = RxData[8];
+    Z21Slave::dataType dataReturn = none;
+    Z21XVersionMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
+    {
+        m_versionData.XBusVersion      = Message.XBusVersion();
+        m_versionData.CommandStationId = Message.CommandStationId();
+
+        dataReturn = lanVersionResponse;
+    }
 
-    return (programmingCvResult);
+    return (dataReturn);
 }
 
 /***********************************************************************************************************************
  */
-Z21Slave::dataType Z21Slave::ProcessGetLocInfo(const uint8_t* RxData)
+Z21Slave::dataType Z21Slave::GetSerialNumber(const uint8_t* DataPtr, uint8_t DataLen)
 {
+    Z21Slave::dataType dataReturn = none;
+    Z21SerialNumberMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
+    {
+        m_versionData.SerialNumber = Message.SerialNumber();
+
+        dataReturn = serialNumberResponse;
+    }
+
+    return (dataReturn);
+}
 
-    m_locInfo.Address = (uint16_t)(RxData[5]) << 8;
-    m_locInfo.Address |= RxData[6];
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::GetHwInfo(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21HwInfoMessage Message(DataPtr, DataLen);
 
-    if (m_locInfo.Address > 127)
+    if (Message.Valid() == true)
     {
-        if ((m_locInfo.Address & 0xC000) == 0xC000)
-        {
-            m_locInfo.Address -= 0xC000;
-        }
+        m_versionData.HwType     = Message.HwType();
+        m_versionData.HwFirmware = Message.FirmwareVersion();
+
+        dataReturn = hwInfoResponse;
     }
 
-    switch (RxData[7] & 0x07)
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::GetRailComData(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21RailComMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
     {
-    case 0:
-        m_locInfo.Steps = locDecoderSpeedSteps14;
-        m_locInfo.Speed = RxData[8] & 0x7F;
-        if (m_locInfo.Speed > 0)
-        {
-            m_locInfo.Speed--;
-        }
-        break;
-    case 2:
-        m_locInfo.Steps = locDecoderSpeedSteps28;
-        m_locInfo.Speed = SpeedStep28TableFromDcc[RxData[8] & 0x7F];
-        break;
-    case 4:
-        m_locInfo.Steps = locDecoderSpeedSteps128;
-        m_locInfo.Speed = RxData[8] & 0x7F;
-        break;
-    default: m_locInfo.Steps = locDecoderSpeedStepsUnknown; break;
+        m_railCom.Address        = Message.Address();
+        m_railCom.ReceiveCounter = Message.ReceiveCounter();
+        m_railCom.ErrorCounter   = Message.ErrorCounter();
+        m_railCom.Options        = Message.Options();
+        m_railCom.Speed          = Message.Speed();
+        m_railCom.Qos            = Message.Qos();
+
+        dataReturn = railComData;
     }
 
-    if (RxData[7] & 0x08)
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::GetSystemState(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21SystemStateMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
     {
-        m_locInfo.Occupied = true;
+        m_systemState.MainCurrent         = Message.MainCurrent();
+        m_systemState.ProgCurrent         = Message.ProgCurrent();
+        m_systemState.FilteredMainCurrent = Message.FilteredMainCurrent();
+        m_systemState.Temperature         = Message.Temperature();
+        m_systemState.SupplyVoltage       = Message.SupplyVoltage();
+        m_systemState.VccVoltage          = Message.VccVoltage();
+        m_systemState.CentralState        = Message.CentralState();
+        m_systemState.CentralStateEx      = Message.CentralStateEx();
+        m_systemState.Capabilities        = Message.Capabilities();
+
+        dataReturn = systemStateData;
     }
-    else
+
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::GetLocoNetMessage(const uint8_t* DataPtr, uint8_t DataLen, dataType Type)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21LocoNetDataMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
     {
-        m_locInfo.Occupied = false;
+        // The view points into the received data, nothing is copied.
+        m_locoNetMessage.Set(Message.LocoNetData(), Message.LocoNetLength());
+
+        dataReturn = (m_locoNetMessage.Valid() == true) ? Type : unknown;
     }
 
-    if (RxData[8] & 0x80)
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::GetLocoNetDispatch(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21LocoNetDispatchMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
     {
-        m_locInfo.Direction = locDirectionForward;
+        m_locoNetDispatch.Address = Message.Address();
+        m_locoNetDispatch.Result  = Message.Result();
+
+        dataReturn = locoNetDispatch;
     }
-    else
+
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::GetLocoNetDetector(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21LocoNetDetectorMessage Message(DataPtr, DataLen);
+
+    if (Message.Valid() == true)
     {
-        m_locInfo.Direction = locDirectionBackward;
+        m_locoNetDetector.Type       = Message.Type();
+        m_locoNetDetector.Address    = Message.Address();
+        m_locoNetDetector.InfoPtr    = Message.Info();
+        m_locoNetDetector.InfoLength = Message.InfoLength();
+
+        dataReturn = locoNetDetector;
     }
 
-    if (RxData[9] & 0x10)
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave::dataType Z21Slave::ProcessGetLocInfo(const uint8_t* DataPtr, uint8_t DataLen)
+{
+    Z21Slave::dataType dataReturn = none;
+    Z21XLocInfoMessage Message(DataPtr, DataLen);
+    const uint8_t* RxDbPtr = Message.Db2ToDb7();
+    locInfoRaw* PreviousPtr;
+    uint8_t Index;
+    uint8_t Db[6];
+    uint8_t Diff[6];
+    uint8_t Unknown;
+    uint8_t Speed;
+    uint8_t SpeedOfSteps[4];
+
+    if (Message.Valid() == true)
     {
-        m_locInfo.Light = locLightOn;
+        m_locInfo.Address = Message.Address();
+
+        // An unknown address or hash collision replaces the entry and reports everything as changed.
+        PreviousPtr = &m_locInfoCache[(m_locInfo.Address ^ (m_locInfo.Address >> 5))
+            & (Z21_SLAVE_LOC_INFO_CACHE_SIZE - 1)];
+        Unknown = ((PreviousPtr->Used == true) && (PreviousPtr->Address == m_locInfo.Address)) ? 0 : 0xFF;
+        PreviousPtr->Used    = true;
+        PreviousPtr->Address = m_locInfo.Address;
+
+        // Read DB2..DB7 once, the same bytes are compared with the previous loc info and decoded below.
+        for (Index = 0; Index < 6; Index++)
+        {
+            Db[Index]                = RxDbPtr[Index];
+            Diff[Index]              = (PreviousPtr->Data[Index] ^ Db[Index]) | Unknown;
+            PreviousPtr->Data[Index] = Db[Index];
+        }
+
+        // The speed of each speed steps mode is computed, the speed steps select one of them.
+        Speed                                     = Db[1] & 0x7F;
+        SpeedOfSteps[locDecoderSpeedSteps14]      = Speed - (Speed != 0);
+        SpeedOfSteps[locDecoderSpeedSteps28]      = SpeedStep28TableFromDcc[Speed & 0x1F];
+        SpeedOfSteps[locDecoderSpeedSteps128]     = Speed;
+        SpeedOfSteps[locDecoderSpeedStepsUnknown] = 0;
+
+        m_locInfo.Steps     = SpeedStepsFromDcc[Db[0] & 0x07];
+        m_locInfo.Speed     = SpeedOfSteps[m_locInfo.Steps];
+        m_locInfo.Occupied  = ((Db[0] & 0x08) != 0);
+        m_locInfo.Direction = (Db[1] & 0x80) ? locDirectionForward : locDirectionBackward;
+        m_locInfo.Light     = (Db[2] & 0x10) ? locLightOn : locLightOff;
+        m_locInfo.Functions = (uint32_t)(Db[2] & 0x0F) | ((uint32_t)(Db[3]) << 4) | ((uint32_t)(Db[4]) << 12)
+            | ((uint32_t)(Db[5]) << 20);
+
+        // The changed bits give the changed fields.
+        m_locInfoChanged.Functions = (uint32_t)(Diff[2] & 0x0F) | ((uint32_t)(Diff[3]) << 4)
+            | ((uint32_t)(Diff[4]) << 12) | ((uint32_t)(Diff[5]) << 20);
+        m_locInfoChanged.Fields    = (uint8_t)((((Diff[0] & 0x07) != 0) * (locInfoChangedSteps | locInfoChangedSpeed))
+            | (((Diff[1] & 0x7F) != 0) * locInfoChangedSpeed) | (((Diff[1] & 0x80) != 0) * locInfoChangedDirection)
+            | (((Diff[2] & 0x10) != 0) * locInfoChangedLight) | (((Diff[0] & 0x08) != 0) * locInfoChangedOccupied)
+            | ((m_locInfoChanged.Functions != 0) * locInfoChangedFunctions));
+
+        dataReturn = locinfo;
     }
-    else
+
+    return (dataReturn);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Slave::UpdateConnect(dataType Type)
+{
+    uint8_t Index;
+
+    switch (Type)
     {
-        m_locInfo.Light = locLightOff;
+    case serialNumberResponse: m_connectPending &= ~ConnectSerialNumber; break;
+    case hwInfoResponse: m_connectPending &= ~ConnectHwInfo; break;
+    case fwVersionInfoResponse: m_connectPending &= ~ConnectFirmware; break;
+    case lanVersionResponse: m_connectPending &= ~ConnectVersion; break;
+    case emergencyStop:
+    case trackPowerOn:
+    case trackPowerOff:
+    case programmingMode: m_connectPending &= ~ConnectStatus; break;
+    case locinfo:
+        for (Index = 0; Index < Z21_SLAVE_CONNECT_LOCS_MAX; Index++)
+        {
+            if (m_connectAddress[Index] == m_locInfo.Address)
+            {
+                m_connectPending &= (uint16_t)(~(1 << (ConnectLocInfoShift + Index)));
+            }
+        }
+        break;
+    default: break;
     }
 
-    m_locInfo.Functions = RxData[9] & 0x0F;
-    m_locInfo.Functions |= (uint32_t)(RxData[10]) << 4;
-    m_locInfo.Functions |= (uint32_t)(RxData[11]) << 12;
-    m_locInfo.Functions |= (uint32_t)(RxData[12]) << 20;
+    if (m_connectPending == 0)
+    {
+        m_connectTime = millis() - m_connectStartTime;
+        if (m_connectTime == 0)
+        {
+            m_connectTime = 1;
+        }
+    }
+}
 
-    return (locinfo);
+/***********************************************************************************************************************
+ */
+void Z21Slave::CheckConnectTimeout()
+{
+    if ((m_connectPending != 0) && ((millis() - m_connectStartTime) >= Z21_SLAVE_CONNECT_TIMEOUT))
+    {
+        // Late responses are ignored, a new LanConnect starts over.
+        m_connectPending = 0;
+        m_connectFailed  = true;
+    }
 }
 
 /***********************************************************************************************************************
@@ -13,14 +13,21 @@
 /***********************************************************************************************************************
  * I N C L U D E S
  **********************************************************************************************************************/
+#include "Z21LocoNet.h"
+#include "Z21Message.h"
 #include <Arduino.h>
 
 /***********************************************************************************************************************
  * T Y P E D E F S  /  E N U M
  **********************************************************************************************************************/
 
-#define Z21_SLAVE_BUFFER_TX_SIZE 30     //!< Buffer size transmit buffer.
-#define Z21_SLAVE_COMMAND_BUFFER_SIZE 3 //!< Command buffer size.
+#define Z21_SLAVE_BUFFER_TX_SIZE 80      //!< Buffer size transmit buffer, fits the connect messages.
+#define Z21_SLAVE_COMMAND_BUFFER_SIZE 3  //!< Command buffer size.
+#define Z21_SLAVE_LOC_INFO_CACHE_SIZE 32 //!< Addresses with previous loc info kept, power of 2.
+#define Z21_SLAVE_KEEPALIVE_TIME 50000   //!< Idle time in ms after which a keepalive message is transmitted.
+#define Z21_SLAVE_LINK_LOST_TIME 60000   //!< Idle time in ms after which the Z21 has dropped the client.
+#define Z21_SLAVE_CONNECT_LOCS_MAX 4     //!< Maximum number of loc info requests in the connect messages.
+#define Z21_SLAVE_CONNECT_TIMEOUT 2000   //!< Time in ms to receive all responses on the connect messages.
 
 /**
  * Typedef for call back function of Z21Lan process commands table.
@@ -49,6 +56,15 @@ public:
         lanVersionResponse,
         fwVersionInfoResponse,
         locLibraryData,
+        serialNumberResponse,
+        hwInfoResponse,
+        railComData,
+        systemStateData,
+        locoNetRx,
+        locoNetTx,
+        locoNetFromLan,
+        locoNetDispatch,
+        locoNetDetector,
         unknown
     };
 
@@ -116,6 +132,28 @@ public:
         bool Occupied;
     };
 
+    /**
+     * Bits of the changed fields in the received locomotive data.
+     */
+    enum locInfoChangedField
+    {
+        locInfoChangedSpeed     = 0x01,
+        locInfoChangedSteps     = 0x02,
+        locInfoChangedDirection = 0x04,
+        locInfoChangedLight     = 0x08,
+        locInfoChangedOccupied  = 0x10,
+        locInfoChangedFunctions = 0x20,
+    };
+
+    /**
+     * Structure with the changes of the received locomotive data compared to the previous data of the same address.
+     */
+    struct locInfoChanged
+    {
+        uint8_t Fields;     /* Bits of locInfoChangedField. */
+        uint32_t Functions; /* Changed function bits, same layout as locInfo::Functions. */
+    };
+
     /**
      * Structure with received CV data.
      */
@@ -125,6 +163,69 @@ public:
         uint8_t Value;
     };
 
+    /**
+     * Structure with received serial number and version data.
+     */
+    struct versionData
+    {
+        uint32_t SerialNumber;
+        uint32_t HwType;
+        uint32_t HwFirmware; /* BCD coded, 0x00000120 is V1.20. */
+        uint8_t XBusVersion;
+        uint8_t CommandStationId;
+        uint8_t FirmwareMajor; /* BCD coded. */
+        uint8_t FirmwareMinor; /* BCD coded. */
+    };
+
+    /**
+     * Structure with received RailCom data.
+     */
+    struct railCom
+    {
+        uint16_t Address;
+        uint32_t ReceiveCounter;
+        uint16_t ErrorCounter;
+        uint8_t Options;
+        uint8_t Speed;
+        uint8_t Qos;
+    };
+
+    /**
+     * Structure with received system state. Currents in mA, temperature in degrees Celsius, voltages in mV.
+     */
+    struct systemState
+    {
+        int16_t MainCurrent;
+        int16_t ProgCurrent;
+        int16_t FilteredMainCurrent;
+        int16_t Temperature;
+        uint16_t SupplyVoltage;
+        uint16_t VccVoltage;
+        uint8_t CentralState;
+        uint8_t CentralStateEx;
+        uint8_t Capabilities;
+    };
+
+    /**
+     * Structure with received LocoNet dispatch result, Result is the slot or 0 when dispatching failed.
+     */
+    struct locoNetDispatchData
+    {
+        uint16_t Address;
+        uint8_t Result;
+    };
+
+    /**
+     * Structure with received LocoNet detector data, Info points into the received data.
+     */
+    struct locoNetDetectorData
+    {
+        uint8_t Type;
+        uint16_t Address;
+        const uint8_t* InfoPtr;
+        uint8_t InfoLength;
+    };
+
     /**
      * Structure with received loclibrary data.
      */
@@ -152,20 +253,78 @@ public:
     Z21Slave();
 
     /**
-     * Process received data.
+     * Process the first message of the received data. Use the variant with an offset for datagrams with more
+     * messages.
      */
     Z21Slave::dataType ProcesDataRx(const uint8_t* DataRxPtr, const uint16_t DataRxLength);
 
+    /**
+     * Process the message at the offset and advance the offset to the next message, so each message of a datagram
+     * reaches the caller before the next one overwrites the decoded data:
+     *   uint16_t Offset = 0;
+     *   while (Offset < Length) { Type = Slave.ProcesDataRx(DataPtr, Length, &Offset); ... }
+     * A truncated or corrupted message sets the offset to the end of the data. Returns none for a message without
+     * decoded data.
+     */
+    Z21Slave::dataType ProcesDataRx(const uint8_t* DataRxPtr, const uint16_t DataRxLength, uint16_t* OffsetPtr);
+
     /**
      * Get data to be transmitted.
      */
     uint8_t* GetDataTx();
 
+    /**
+     * Get length of data to be transmitted, can be more than one message after LanConnect.
+     */
+    uint16_t GetDataTxLength();
+
     /**
      * Check if Tx data is present.
      */
     bool txDataPresent();
 
+    /**
+     * Check if Tx data is present without taking it, nothing new should be composed while it is pending.
+     */
+    bool TxDataPending();
+
+    /**
+     * Compose all requests required after connecting in one transmit buffer: serial number, hardware info, firmware
+     * version, version, status, broadcast flags and loc info of the addresses.
+     */
+    void LanConnect(uint32_t Flags, const uint16_t* AddressPtr, uint8_t NrOfAddresses);
+
+    /**
+     * Check if all responses on the LanConnect requests are received.
+     */
+    bool ConnectReady();
+
+    /**
+     * Time in ms between LanConnect and receiving the last response, 0 when not ready.
+     */
+    uint32_t ConnectTime();
+
+    /**
+     * Check if not all responses on the LanConnect requests are received within Z21_SLAVE_CONNECT_TIMEOUT.
+     */
+    bool ConnectFailed();
+
+    /**
+     * Transmit a keepalive message when the link is idle or re-subscribe the broadcast flags after a reconnect.
+     * Call this cyclic, it only composes a message if no other message is pending.
+     */
+    bool KeepAlive();
+
+    /**
+     * 2.1 LAN_GET_SERIAL_NUMBER
+     */
+    void LanGetSerialNumber();
+
+    /**
+     * 2.3 LAN_X_GET_VERSION
+     */
+    void LanXGetVersion();
+
     /**
      * 2.4 LAN_X_GET_STATUS
      */
@@ -186,18 +345,33 @@ public:
      */
     void LanSetStop();
 
+    /**
+     * 2.15 LAN_X_GET_FIRMWARE_VERSION
+     */
+    void LanXGetFirmwareVersion();
+
     /**
      * 2.16 LAN_SET_BROADCASTFLAGS
      */
     void LanSetBroadCastFlags(uint32_t Flags);
 
+    /**
+     * 2.20 LAN_GET_HWINFO
+     */
+    void LanGetHwInfo();
+
+    /**
+     * 2.1, 2.3, 2.15 and 2.20 serial number and version data.
+     */
+    versionData* LanVersionData();
+
     /**
      * 4.1 LAN_X_GET_LOCO_INFO
      */
     void LanXGetLocoInfo(uint16_t Address);
 
     /**
-     * 4.2 LAN_X_SET_LOCO_DRIVE
+     * 4.2 LAN_X_SET_LOCO_DRIVE, the speed is limited to the maximum of the speed steps.
      */
     void LanXSetLocoDrive(locInfo* LocInfoPtr);
 
@@ -211,6 +385,13 @@ public:
      */
     Z21Slave::locInfo* LanXLocoInfo();
 
+    /**
+     * 4.4 LAN_X_LOCO_INFO, changes compared to the previous loc info of the same address returned by ProcesDataRx.
+     * For an address not received before, or replaced in the cache by an address with the same hash, all fields are
+     * marked as changed.
+     */
+    Z21Slave::locInfoChanged* LanXLocoInfoChanged();
+
     /**
      * 6.5 LAN_X_CV_RESULT
      */
@@ -235,6 +416,57 @@ public:
      */
     void LanXCvPomWriteByte(uint16_t Address, uint16_t CvNumber, uint8_t CvValue);
 
+    /**
+     * 8.2 LAN_RAILCOM_GETDATA
+     */
+    void LanRailComGetData(uint16_t Address);
+
+    /**
+     * 8.1 LAN_RAILCOM_DATACHANGED
+     */
+    railCom* LanRailComData();
+
+    /**
+     * 2.19 LAN_SYSTEMSTATE_GETDATA
+     */
+    void LanSystemStateGetData();
+
+    /**
+     * 2.18 LAN_SYSTEMSTATE_DATACHANGED
+     */
+    systemState* LanSystemStateData();
+
+    /**
+     * 9.3 LAN_LOCONET_FROM_LAN, the message is copied directly in the transmit buffer and its last byte is replaced by
+     * the LocoNet checksum.
+     */
+    void LanLocoNetFromLan(const uint8_t* LocoNetPtr, uint8_t Length);
+
+    /**
+     * 9.4 LAN_LOCONET_DISPATCH_ADDR
+     */
+    void LanLocoNetDispatchAddr(uint16_t Address);
+
+    /**
+     * 9.5 LAN_LOCONET_DETECTOR
+     */
+    void LanLocoNetDetector(uint8_t Type, uint16_t ReportAddress);
+
+    /**
+     * 9.1 - 9.3 received LocoNet message, valid until the next call of ProcesDataRx.
+     */
+    Z21LocoNetMessage* LanLocoNetMessage();
+
+    /**
+     * 9.4 LAN_LOCONET_DISPATCH_ADDR response.
+     */
+    locoNetDispatchData* LanLocoNetDispatchData();
+
+    /**
+     * 9.5 LAN_LOCONET_DETECTOR response, valid until the next call of ProcesDataRx.
+     */
+    locoNetDetectorData* LanLocoNetDetectorData();
+
     /**
      * x.x LAN_X_LOC_LIB_DATA_TRANSMIT
      */
@@ -248,9 +480,41 @@ public:
 private:
     uint8_t m_BufferTx[Z21_SLAVE_BUFFER_TX_SIZE]; /* Transmit buffer. */
     locInfo m_locInfo;                            /* Actual received loc info. */
+    locInfoChanged m_locInfoChanged;              /* Changes of actual received loc info. */
     cvData m_CvData;                              /* Received cv programming data. */
     locLibData m_locLibData;                      /* Received loclib data. */
     bool m_txDataPresent;                         /* Data present to be transmitted. */
+    uint16_t m_txLength;                          /* Length of data to be transmitted. */
+    bool m_txAppend;                              /* Append composed message to the transmit buffer. */
+    versionData m_versionData;                    /* Received serial number and version data. */
+    railCom m_railCom;                            /* Received RailCom data. */
+    systemState m_systemState;                    /* Received system state. */
+    Z21LocoNetMessage m_locoNetMessage;           /* Received LocoNet message. */
+    locoNetDispatchData m_locoNetDispatch;        /* Received LocoNet dispatch result. */
+    locoNetDetectorData m_locoNetDetector;        /* Received LocoNet detector data. */
+    uint32_t m_txLastTime;                        /* Time of last composed message. */
+    uint32_t m_rxLastTime;                        /* Time of last received message. */
+    bool m_rxReceived;                            /* At least one message received. */
+    uint32_t m_broadcastFlags;                    /* Broadcast flags to restore after a reconnect. */
+    bool m_reSubscribe;                           /* Broadcast flags must be transmitted again. */
+
+    /**
+     * Typedef struct for the previous received loc info bytes DB2..DB7 of an address.
+     */
+    typedef struct
+    {
+        uint16_t Address;
+        uint8_t Data[6];
+        bool Used;
+    } locInfoRaw;
+
+    locInfoRaw m_locInfoCache[Z21_SLAVE_LOC_INFO_CACHE_SIZE]; /* Previous loc info, indexed by address hash. */
+
+    uint16_t m_connectAddress[Z21_SLAVE_CONNECT_LOCS_MAX]; /* Loc info addresses requested by LanConnect. */
+    uint16_t m_connectPending;                             /* Bits of LanConnect responses not yet received. */
+    uint32_t m_connectStartTime;                           /* Time of LanConnect. */
+    uint32_t m_connectTime;                                /* Time until all LanConnect responses are received. */
+    bool m_connectFailed;                                  /* Not all LanConnect responses received in time. */
 
     /* Conversion table for normal speed to 28 steps DCC speed. */
     const uint8_t SpeedStep28TableToDcc[29] = { 16, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23, 8, 24, 9, 25, 10, 26, 11,
@@ -260,50 +524,112 @@ private:
     const uint8_t SpeedStep28TableFromDcc[32] = { 0, 0, 1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 0, 0, 2, 4,
         6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28 };
 
+    /* Conversion table for the speed steps in DB2 of the loc info. */
+    const locDecoderSteps SpeedStepsFromDcc[8] = { locDecoderSpeedSteps14, locDecoderSpeedStepsUnknown,
+        locDecoderSpeedSteps28, locDecoderSpeedStepsUnknown, locDecoderSpeedSteps128, locDecoderSpeedStepsUnknown,
+        locDecoderSpeedStepsUnknown, locDecoderSpeedStepsUnknown };
+
+    /**
+     * Compose the data to be transmitted. Returns false when the message does not fit in the transmit buffer.
+     */
+    bool ComposeTxMessage(uint8_t Header, const uint8_t* TxData, uint16_t TxLength, bool ChecksumCalc);
+
+    /**
+     * Decode one received message, DataLen is checked by Z21Message::FramedLength. Each decoder validates the message
+     * with the view of its message type and returns none when the message is not valid.
+     */
+    dataType DecodeMessage(const uint8_t* DataPtr, uint8_t DataLen);
+
     /**
-     * Compose the data to be transmitted.
+     * Decode a received X-Bus message.
      */
-    void ComposeTxMessage(uint8_t Header, uint8_t* TxData, uint16_t TxLength, bool ChecksumCalc);
+    dataType DecodeXMessage(const uint8_t* DataPtr, uint8_t DataLen);
 
     /**
-     * Decode the received data.
+     * Return the type for a valid X-Bus message without data.
      */
-    dataType DecodeRxMessage(const uint8_t* RxData, uint16_t RxLength);
+    dataType XMessageType(const uint8_t* DataPtr, uint8_t DataLen, dataType Type);
 
     /**
      * Decoder the locomotive library data.
      */
-    dataType ProcessLocLibraryData(const uint8_t* RxData);
+    dataType ProcessLocLibraryData(const uint8_t* DataPtr, uint8_t DataLen);
 
     /**
      * Decode the status message.
      */
-    dataType Status(const uint8_t* RxData);
+    dataType Status(const uint8_t* DataPtr, uint8_t DataLen);
 
     /**
      * Decode the status message for track power.
      */
-    dataType TrackPower(const uint8_t* RxData);
+    dataType TrackPower(const uint8_t* DataPtr, uint8_t DataLen);
 
     /**
      * Decode the CV response data.
      */
-    dataType GetCVData(const uint8_t* RxData);
+    dataType GetCVData(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the firmware version.
+     */
+    dataType GetFirmwareInfo(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the X-Bus version and command station id.
+     */
+    dataType GetVersion(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the serial number.
+     */
+    dataType GetSerialNumber(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the hardware info.
+     */
+    dataType GetHwInfo(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the RailCom data.
+     */
+    dataType GetRailComData(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the system state.
+     */
+    dataType GetSystemState(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode a tunneled LocoNet message, the type tells if the Z21 received or transmitted it.
+     */
+    dataType GetLocoNetMessage(const uint8_t* DataPtr, uint8_t DataLen, dataType Type);
+
+    /**
+     * Decode the LocoNet dispatch result.
+     */
+    dataType GetLocoNetDispatch(const uint8_t* DataPtr, uint8_t DataLen);
+
+    /**
+     * Decode the LocoNet detector data.
+     */
+    dataType GetLocoNetDetector(const uint8_t* DataPtr, uint8_t DataLen);
 
     /**
-     * Compose the version info.
+     * Mark a received response of the LanConnect requests.
      */
-    dataType GetFirmwareInfo(const uint8_t* RxData);
+    void UpdateConnect(dataType Type);
 
     /**
-     * Get the version.
+     * Stop waiting for the LanConnect responses when the timeout has expired.
      */
-    dataType GetVersion(const uint8_t* RxData);
+    void CheckConnectTimeout();
 
     /**
-     * Decode the received loc info message.
+     * Decode the received loc info message and compare DB2..DB7 with the previous loc info of the address in the same
+     * pass.
      */
-    dataType ProcessGetLocInfo(const uint8_t* RxData);
+    dataType ProcessGetLocInfo(const uint8_t* DataPtr, uint8_t DataLen);
 
     /**
      * Convert loc adresses to Z21 format.
@@ -0,0 +1,164 @@
+/***********************************************************************************************************************
+   @file   Z21StationMap.cpp
+   @brief  Z21 command station address map implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21StationMap.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21StationMap::Z21StationMap()
+{
+    m_Default = Z21_STATION_NONE;
+    Clear();
+}
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21StationMap::Clear() { m_NrOfRanges = 0; }
+
+/***********************************************************************************************************************
+ */
+void Z21StationMap::SetDefault(uint8_t Station) { m_Default = Station; }
+
+/***********************************************************************************************************************
+ */
+bool Z21StationMap::Add(uint16_t FirstAddress, uint16_t LastAddress, uint8_t Station)
+{
+    bool Result   = false;
+    uint8_t Index = 0;
+
+    if ((m_NrOfRanges < Z21_STATION_MAP_RANGES_MAX) && (FirstAddress <= LastAddress))
+    {
+        while ((Index < m_NrOfRanges) && (m_Ranges[Index].LastAddress < FirstAddress))
+        {
+            Index++;
+        }
+
+        // Keep the ranges sorted, the next range must start behind the new one.
+        if ((Index == m_NrOfRanges) || (m_Ranges[Index].FirstAddress > LastAddress))
+        {
+            memmove(&m_Ranges[Index + 1], &m_Ranges[Index], (m_NrOfRanges - Index) * sizeof(stationRange));
+            m_Ranges[Index].FirstAddress = FirstAddress;
+            m_Ranges[Index].LastAddress  = LastAddress;
+            m_Ranges[Index].Station      = Station;
+            m_NrOfRanges++;
+            Result = true;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21StationMap::Station(uint16_t Address)
+{
+    uint8_t Low    = 0;
+    uint8_t High   = m_NrOfRanges;
+    uint8_t Middle = 0;
+    uint8_t Result = m_Default;
+
+    while (Low < High)
+    {
+        Middle = (Low + High) / 2;
+        if (m_Ranges[Middle].LastAddress < Address)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    if ((Low < m_NrOfRanges) && (m_Ranges[Low].FirstAddress <= Address))
+    {
+        Result = m_Ranges[Low].Station;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21StationMap::StationOfMessage(const uint8_t* DataPtr, uint16_t Length, uint16_t* MessageLengthPtr)
+{
+    uint8_t Result   = m_Default;
+    uint16_t DataLen = 0;
+
+    if (Length >= 4)
+    {
+        DataLen = (uint16_t)(DataPtr[0]) | ((uint16_t)(DataPtr[1]) << 8);
+    }
+
+    if ((DataLen < 4) || (DataLen > Length))
+    {
+        // No complete message, the remaining data can not be routed.
+        DataLen = 0;
+    }
+    else
+    {
+        switch (DataPtr[2])
+        {
+        case 0x40:
+            if (DataLen >= 8)
+            {
+                switch (DataPtr[4])
+                {
+                case 0xE3:
+                case 0xE4:
+                    // LAN_X_GET_LOCO_INFO, LAN_X_SET_LOCO_DRIVE and LAN_X_SET_LOCO_FUNCTION.
+                    Result = Station(((uint16_t)(DataPtr[6] & 0x3F) << 8) | DataPtr[7]);
+                    break;
+                case 0xE6:
+                    // LAN_X_CV_POM_WRITE_BYTE.
+                    if (DataPtr[5] == 0x30)
+                    {
+                        Result = Station(((uint16_t)(DataPtr[6] & 0x3F) << 8) | DataPtr[7]);
+                    }
+                    break;
+                default: break;
+                }
+            }
+            break;
+        case 0x89:
+            // LAN_RAILCOM_GETDATA.
+            if (DataLen >= 7)
+            {
+                Result = Station((uint16_t)(DataPtr[5]) | ((uint16_t)(DataPtr[6]) << 8));
+            }
+            break;
+        case 0xA3:
+            // LAN_LOCONET_DISPATCH_ADDR.
+            if (DataLen >= 6)
+            {
+                Result = Station((uint16_t)(DataPtr[4]) | ((uint16_t)(DataPtr[5]) << 8));
+            }
+            break;
+        default: break;
+        }
+    }
+
+    *MessageLengthPtr = DataLen;
+
+    return (Result);
+}
@@ -0,0 +1,78 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21StationMap.h
+ * @brief Map of locomotive addresses to command stations, for a gateway which uses one Z21Slave per command station.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_STATION_MAP_H
+#define Z21_STATION_MAP_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_STATION_MAP_RANGES_MAX 16 //!< Maximum number of address ranges.
+#define Z21_STATION_NONE 0xFF         //!< No command station.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21StationMap
+{
+public:
+    /**
+     * Constructor
+     */
+    Z21StationMap();
+
+    /**
+     * Remove all ranges, all addresses go to the default station.
+     */
+    void Clear();
+
+    /**
+     * Station for addresses which are not in a range.
+     */
+    void SetDefault(uint8_t Station);
+
+    /**
+     * Add an address range for a station. Returns false when the map is full or the range overlaps another range.
+     */
+    bool Add(uint16_t FirstAddress, uint16_t LastAddress, uint8_t Station);
+
+    /**
+     * Station of a locomotive address.
+     */
+    uint8_t Station(uint16_t Address);
+
+    /**
+     * Station of the first Z21 message in the data. Messages with a locomotive address (loc info, drive, function,
+     * POM, RailCom and LocoNet dispatch messages) go to the station of the address, all other messages to the default
+     * station. MessageLengthPtr receives the DataLen of the message, 0 when the data holds no complete message. A
+     * datagram with more messages is routed by calling this again behind each message.
+     */
+    uint8_t StationOfMessage(const uint8_t* DataPtr, uint16_t Length, uint16_t* MessageLengthPtr);
+
+private:
+    /**
+     * Typedef struct for an address range.
+     */
+    typedef struct
+    {
+        uint16_t FirstAddress;
+        uint16_t LastAddress;
+        uint8_t Station;
+    } stationRange;
+
+    stationRange m_Ranges[Z21_STATION_MAP_RANGES_MAX]; /* Ranges sorted by address. */
+    uint8_t m_NrOfRanges;                              /* Number of ranges. */
+    uint8_t m_Default;                                 /* Station for addresses not in a range. */
+};
+
+#endif
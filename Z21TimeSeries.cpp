@@ -0,0 +1,190 @@
+/***********************************************************************************************************************
+   @file   Z21TimeSeries.cpp
+   @brief  Z21 system state time series implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21TimeSeries.h"
+#include <string.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21TimeSeries::Z21TimeSeries() { Clear(); }
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void Z21TimeSeries::Clear()
+{
+    memset(m_Values, 0, sizeof(m_Values));
+    memset(&m_MinQueue, 0, sizeof(m_MinQueue));
+    memset(&m_MaxQueue, 0, sizeof(m_MaxQueue));
+    m_Number      = 0;
+    m_Samples     = 0;
+    m_Sum         = 0;
+    m_WeightedSum = 0;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21TimeSeries::Add(int16_t Value)
+{
+    // The new sample replaces the oldest one, all other samples move one position towards the start.
+    if (m_Samples == Z21_TIME_SERIES_SIZE)
+    {
+        m_Sum -= m_Values[m_Number % Z21_TIME_SERIES_SIZE];
+        m_WeightedSum -= m_Sum;
+        m_Samples--;
+    }
+
+    m_Values[m_Number % Z21_TIME_SERIES_SIZE] = Value;
+    m_WeightedSum += (int32_t)(m_Samples) * Value;
+    m_Sum += Value;
+    m_Samples++;
+
+    QueueAdd(&m_MinQueue, true);
+    QueueAdd(&m_MaxQueue, false);
+
+    m_Number++;
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21TimeSeries::Samples() { return (m_Samples); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21TimeSeries::Latest()
+{
+    int16_t Value = 0;
+
+    if (m_Samples > 0)
+    {
+        Value = m_Values[(uint16_t)(m_Number - 1) % Z21_TIME_SERIES_SIZE];
+    }
+
+    return (Value);
+}
+
+/***********************************************************************************************************************
+ */
+int16_t Z21TimeSeries::Minimum() { return (QueueFront(&m_MinQueue)); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21TimeSeries::Maximum() { return (QueueFront(&m_MaxQueue)); }
+
+/***********************************************************************************************************************
+ */
+int16_t Z21TimeSeries::Mean()
+{
+    int16_t Value = 0;
+
+    if (m_Samples > 0)
+    {
+        Value = (int16_t)(m_Sum / m_Samples);
+    }
+
+    return (Value);
+}
+
+/***********************************************************************************************************************
+ * Slope = (n * Sum(x * y) - Sum(x) * Sum(y)) / (n * Sum(x * x) - Sum(x)^2) with x the position 0 .. n - 1.
+ */
+int32_t Z21TimeSeries::Slope()
+{
+    int64_t Samples = m_Samples;
+    int64_t SumX;
+    int64_t SumXX;
+    int32_t Slope = 0;
+
+    if (m_Samples > 1)
+    {
+        SumX  = (Samples * (Samples - 1)) / 2;
+        SumXX = ((Samples - 1) * Samples * ((2 * Samples) - 1)) / 6;
+        Slope = (int32_t)((((Samples * m_WeightedSum) - (SumX * m_Sum)) * 256) / ((Samples * SumXX) - (SumX * SumX)));
+    }
+
+    return (Slope);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21TimeSeries::TrendAbove(int16_t Limit, uint8_t Samples)
+{
+    int64_t Projected;
+
+    if (m_Samples > 1)
+    {
+        // The trend line passes the mean in the middle of the window.
+        Projected = ((int64_t)(m_Sum) * 256) / m_Samples;
+        Projected += ((int64_t)(Slope()) * ((m_Samples - 1) + (2 * Samples))) / 2;
+    }
+    else
+    {
+        Projected = (int64_t)(Latest()) * 256;
+    }
+
+    return ((m_Samples > 0) && (Projected >= ((int64_t)(Limit) * 256)));
+}
+
+/***********************************************************************************************************************
+ */
+void Z21TimeSeries::QueueAdd(sampleQueue* QueuePtr, bool Minimum)
+{
+    int16_t Value = m_Values[m_Number % Z21_TIME_SERIES_SIZE];
+    int16_t BackValue;
+
+    while ((QueuePtr->Size > 0) && ((uint16_t)(m_Number - QueuePtr->Items[QueuePtr->Head]) >= Z21_TIME_SERIES_SIZE))
+    {
+        QueuePtr->Head = (QueuePtr->Head + 1) % Z21_TIME_SERIES_SIZE;
+        QueuePtr->Size--;
+    }
+
+    // A sample which is older and not better than the new one can never be the extreme again.
+    while (QueuePtr->Size > 0)
+    {
+        BackValue = m_Values[QueuePtr->Items[(QueuePtr->Head + QueuePtr->Size - 1) % Z21_TIME_SERIES_SIZE]
+            % Z21_TIME_SERIES_SIZE];
+        if ((Minimum == true) ? (BackValue >= Value) : (BackValue <= Value))
+        {
+            QueuePtr->Size--;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    QueuePtr->Items[(QueuePtr->Head + QueuePtr->Size) % Z21_TIME_SERIES_SIZE] = m_Number;
+    QueuePtr->Size++;
+}
+
+/***********************************************************************************************************************
+ */
+int16_t Z21TimeSeries::QueueFront(sampleQueue* QueuePtr)
+{
+    int16_t Value = 0;
+
+    if (QueuePtr->Size > 0)
+    {
+        Value = m_Values[QueuePtr->Items[QueuePtr->Head] % Z21_TIME_SERIES_SIZE];
+    }
+
+    return (Value);
+}
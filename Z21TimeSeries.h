@@ -0,0 +1,111 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21TimeSeries.h
+ * @brief Window of the last samples of one system state value, like the main current, with minimum, maximum, mean
+ *        and trend available in constant time.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_TIME_SERIES_H
+#define Z21_TIME_SERIES_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include <Arduino.h>
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+#define Z21_TIME_SERIES_SIZE 32 //!< Number of samples in the window, power of two, 128 at most.
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+class Z21TimeSeries
+{
+public:
+    /**
+     * Constructor
+     */
+    Z21TimeSeries();
+
+    /**
+     * Remove all samples.
+     */
+    void Clear();
+
+    /**
+     * Add a sample, when the window is full the oldest sample is removed.
+     */
+    void Add(int16_t Value);
+
+    /**
+     * Number of samples in the window.
+     */
+    uint8_t Samples();
+
+    /**
+     * Latest sample, 0 when empty.
+     */
+    int16_t Latest();
+
+    /**
+     * Minimum of the window, 0 when empty.
+     */
+    int16_t Minimum();
+
+    /**
+     * Maximum of the window, 0 when empty.
+     */
+    int16_t Maximum();
+
+    /**
+     * Mean of the window, 0 when empty.
+     */
+    int16_t Mean();
+
+    /**
+     * Least squares slope of the window in value per sample, 8.8 fixed point.
+     */
+    int32_t Slope();
+
+    /**
+     * Check if the trend line of the window reaches the limit within the number of samples, for example to detect a
+     * rising main current before the overcurrent shutdown.
+     */
+    bool TrendAbove(int16_t Limit, uint8_t Samples);
+
+private:
+    /**
+     * Typedef struct for a queue of sample numbers with increasing (minimum) or decreasing (maximum) values.
+     */
+    typedef struct
+    {
+        uint16_t Items[Z21_TIME_SERIES_SIZE];
+        uint8_t Head;
+        uint8_t Size;
+    } sampleQueue;
+
+    int16_t m_Values[Z21_TIME_SERIES_SIZE]; /* Samples, indexed by sample number. */
+    uint16_t m_Number;                      /* Sample number of the next sample. */
+    uint8_t m_Samples;                      /* Number of samples in the window. */
+    int32_t m_Sum;                          /* Sum of the samples. */
+    int32_t m_WeightedSum;                  /* Sum of the samples times their position, oldest is 0. */
+    sampleQueue m_MinQueue;                 /* Candidates for the minimum, oldest first. */
+    sampleQueue m_MaxQueue;                 /* Candidates for the maximum, oldest first. */
+
+    /**
+     * Remove samples outside the window from the front and samples which can not become the extreme anymore from
+     * the back, then add the newest sample.
+     */
+    void QueueAdd(sampleQueue* QueuePtr, bool Minimum);
+
+    /**
+     * Value of the first queue item.
+     */
+    int16_t QueueFront(sampleQueue* QueuePtr);
+};
+
+#endif
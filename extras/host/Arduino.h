@@ -0,0 +1,27 @@
+/**
+ **********************************************************************************************************************
+ * @file  Arduino.h
+ * @brief Minimal Arduino replacement to build the library on a host for the fuzz target and the benchmark.
+ ***********************************************************************************************************************
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***********************************************************************************************************************
+ * F U N C T I O N S
+ **********************************************************************************************************************/
+
+/**
+ * Milliseconds since start, provided by the host program.
+ */
+unsigned long millis();
+
+#endif
@@ -0,0 +1,696 @@
+/***********************************************************************************************************************
+   @file   Z21Client.cpp
+   @brief  Awaitable Z21 requests and single threaded epoll executor implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Client.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+static uint8_t* FramePoolPtr = NULL; /* Memory of all coroutine frames. */
+static void* FrameFreePtr    = NULL; /* First free frame, each free frame starts with the pointer to the next. */
+static uint16_t FrameSize    = 0;    /* Size of a frame. */
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21Task::Z21Task(bool Started) : m_Started(Started) {}
+
+/***********************************************************************************************************************
+ */
+Z21Wait::Z21Wait(Z21Client* ClientPtr, Z21Slave::dataType Type, uint16_t Key, uint32_t Timeout)
+{
+    m_ClientPtr   = ClientPtr;
+    m_Type        = Type;
+    m_Key         = Key;
+    m_Timeout     = Timeout;
+    m_Status      = z21StatusTimeout;
+    m_CvValue     = 0;
+    m_Deadline    = 0;
+    m_HeapIndex   = 0;
+    m_PrevPtr     = NULL;
+    m_NextPtr     = NULL;
+    m_ListPtr     = NULL;
+    m_ListLastPtr = NULL;
+    memset(&m_LocInfo, 0, sizeof(m_LocInfo));
+}
+
+/***********************************************************************************************************************
+ */
+Z21CvRead::Z21CvRead(Z21Client* ClientPtr, uint16_t CvNumber, uint32_t Timeout)
+    : Z21Wait(ClientPtr, Z21Slave::programmingCvResult, CvNumber, Timeout)
+{
+}
+
+/***********************************************************************************************************************
+ */
+Z21LocInfoGet::Z21LocInfoGet(Z21Client* ClientPtr, uint16_t Address, uint32_t Timeout)
+    : Z21Wait(ClientPtr, Z21Slave::locinfo, Address, Timeout)
+{
+}
+
+/***********************************************************************************************************************
+ */
+Z21Executor::Z21Executor()
+{
+    m_EpollFd  = -1;
+    m_HeapPtr  = NULL;
+    m_HeapSize = 0;
+    m_HeapMax  = 0;
+    m_Stop     = false;
+}
+
+/***********************************************************************************************************************
+ */
+Z21Executor::~Z21Executor()
+{
+    if (m_EpollFd >= 0)
+    {
+        close(m_EpollFd);
+    }
+    free(m_HeapPtr);
+}
+
+/***********************************************************************************************************************
+ */
+Z21Client::Z21Client(Z21Executor* ExecutorPtr)
+{
+    uint8_t Index;
+
+    m_ExecutorPtr    = ExecutorPtr;
+    m_Fd             = -1;
+    m_Poll.ReadyFunc = Ready;
+    m_Poll.ArgPtr    = this;
+    m_CvWaitPtr      = NULL;
+    m_CvWaitLastPtr  = NULL;
+
+    for (Index = 0; Index < Z21_CLIENT_LOC_LISTS; Index++)
+    {
+        m_LocWaitPtr[Index]     = NULL;
+        m_LocWaitLastPtr[Index] = NULL;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+Z21Client::~Z21Client() { Close(); }
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+void* Z21Task::promise_type::operator new(size_t Size) noexcept
+{
+    void* Result = NULL;
+
+    if ((Size <= FrameSize) && (FrameFreePtr != NULL))
+    {
+        Result       = FrameFreePtr;
+        FrameFreePtr = *(void**)FrameFreePtr;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Task::promise_type::operator delete(void* FramePtr)
+{
+    *(void**)FramePtr = FrameFreePtr;
+    FrameFreePtr      = FramePtr;
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Task::Reserve(uint16_t Frames, uint16_t Size)
+{
+    bool Result = false;
+    uint16_t Index;
+
+    // Each frame keeps the alignment of malloc.
+    Size = (Size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    if ((FramePoolPtr == NULL) && (Frames > 0) && (Size >= sizeof(void*)))
+    {
+        FramePoolPtr = (uint8_t*)malloc((size_t)Frames * Size);
+        if (FramePoolPtr != NULL)
+        {
+            FrameSize = Size;
+            for (Index = Frames; Index > 0; Index--)
+            {
+                Z21Task::promise_type::operator delete(&FramePoolPtr[(size_t)(Index - 1) * Size]);
+            }
+            Result = true;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Task::Started() { return (m_Started); }
+
+/***********************************************************************************************************************
+ */
+bool Z21Wait::await_suspend(std::coroutine_handle<> Handle)
+{
+    bool Result              = false;
+    Z21Executor* ExecutorPtr = m_ClientPtr->m_ExecutorPtr;
+
+    m_Handle   = Handle;
+    m_Deadline = ExecutorPtr->Now() + m_Timeout;
+
+    if ((m_ClientPtr->m_Fd >= 0) && (ExecutorPtr->Insert(this) == true))
+    {
+        m_ClientPtr->Request(this);
+        Result = true;
+    }
+    else
+    {
+        // Not suspended, the coroutine continues with the status.
+        m_Status = z21StatusBusy;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+z21CvResult Z21CvRead::await_resume()
+{
+    z21CvResult Result;
+
+    Result.Status = m_Status;
+    Result.Number = m_Key;
+    Result.Value  = m_CvValue;
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+z21LocInfoResult Z21LocInfoGet::await_resume()
+{
+    z21LocInfoResult Result;
+
+    Result.Status  = m_Status;
+    Result.LocInfo = m_LocInfo;
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Executor::Init(uint16_t MaxWaits)
+{
+    bool Result = false;
+
+    if ((m_EpollFd < 0) && (MaxWaits > 0))
+    {
+        m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+        m_HeapPtr = (Z21Wait**)malloc(MaxWaits * sizeof(Z21Wait*));
+        m_HeapMax = MaxWaits;
+        Result    = (m_EpollFd >= 0) && (m_HeapPtr != NULL);
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Executor::Add(int Fd, z21Poll* PollPtr)
+{
+    struct epoll_event Event;
+
+    Event.events   = EPOLLIN;
+    Event.data.ptr = PollPtr;
+
+    return (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, Fd, &Event) == 0);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Remove(int Fd) { epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, Fd, NULL); }
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Run()
+{
+    m_Stop = false;
+
+    while ((m_Stop == false) && (m_HeapSize > 0))
+    {
+        RunOnce(Z21_CLIENT_TIMEOUT);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::RunOnce(uint32_t MaxWait)
+{
+    struct epoll_event Events[Z21_EXECUTOR_EVENTS];
+    int Count;
+    int Index;
+    int32_t Remaining;
+    z21Poll* PollPtr;
+
+    // Wait at most until the first timeout.
+    if (m_HeapSize > 0)
+    {
+        Remaining = (int32_t)(m_HeapPtr[0]->m_Deadline - Now());
+        if (Remaining < 0)
+        {
+            Remaining = 0;
+        }
+        if ((uint32_t)Remaining < MaxWait)
+        {
+            MaxWait = (uint32_t)Remaining;
+        }
+    }
+
+    Count = epoll_wait(m_EpollFd, Events, Z21_EXECUTOR_EVENTS, (int)MaxWait);
+    for (Index = 0; Index < Count; Index++)
+    {
+        PollPtr = (z21Poll*)Events[Index].data.ptr;
+        PollPtr->ReadyFunc(PollPtr->ArgPtr);
+    }
+
+    Expire();
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Stop() { m_Stop = true; }
+
+/***********************************************************************************************************************
+ */
+uint16_t Z21Executor::Pending() { return (m_HeapSize); }
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21Executor::Now()
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return ((uint32_t)Time.tv_sec * 1000 + (uint32_t)(Time.tv_nsec / 1000000));
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Executor::Insert(Z21Wait* WaitPtr)
+{
+    bool Result = false;
+
+    if (m_HeapSize < m_HeapMax)
+    {
+        Set(m_HeapSize, WaitPtr);
+        m_HeapSize++;
+        Place(m_HeapSize - 1);
+        Result = true;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Erase(Z21Wait* WaitPtr)
+{
+    uint16_t Index = WaitPtr->m_HeapIndex;
+
+    m_HeapSize--;
+    if (Index != m_HeapSize)
+    {
+        Set(Index, m_HeapPtr[m_HeapSize]);
+        Place(Index);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Place(uint16_t Index)
+{
+    Z21Wait* WaitPtr = m_HeapPtr[Index];
+    uint16_t Child;
+
+    // Deadlines are compared with their difference, so the wrap of the ms counter does not matter.
+    while ((Index > 0) && ((int32_t)(WaitPtr->m_Deadline - m_HeapPtr[(Index - 1) / 2]->m_Deadline) < 0))
+    {
+        Set(Index, m_HeapPtr[(Index - 1) / 2]);
+        Index = (Index - 1) / 2;
+    }
+
+    Child = 2 * Index + 1;
+    while (Child < m_HeapSize)
+    {
+        if (((Child + 1) < m_HeapSize)
+            && ((int32_t)(m_HeapPtr[Child + 1]->m_Deadline - m_HeapPtr[Child]->m_Deadline) < 0))
+        {
+            Child++;
+        }
+        if ((int32_t)(m_HeapPtr[Child]->m_Deadline - WaitPtr->m_Deadline) >= 0)
+        {
+            break;
+        }
+        Set(Index, m_HeapPtr[Child]);
+        Index = Child;
+        Child = 2 * Index + 1;
+    }
+
+    Set(Index, WaitPtr);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Set(uint16_t Index, Z21Wait* WaitPtr)
+{
+    m_HeapPtr[Index]     = WaitPtr;
+    WaitPtr->m_HeapIndex = Index;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Executor::Expire()
+{
+    uint32_t Time       = Now();
+    Z21Wait* ReadyPtr   = NULL;
+    Z21Wait** ReadyLast = &ReadyPtr;
+    Z21Wait* WaitPtr;
+
+    // First collect, the resumed coroutines may add requests to the heap.
+    while ((m_HeapSize > 0) && ((int32_t)(m_HeapPtr[0]->m_Deadline - Time) <= 0))
+    {
+        WaitPtr = m_HeapPtr[0];
+        Erase(WaitPtr);
+        Z21Client::Unlink(WaitPtr);
+        WaitPtr->m_Status  = z21StatusTimeout;
+        WaitPtr->m_NextPtr = NULL;
+        *ReadyLast         = WaitPtr;
+        ReadyLast          = &WaitPtr->m_NextPtr;
+    }
+
+    Z21Client::Resume(ReadyPtr);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21Client::Open(const char* HostPtr, uint16_t Port)
+{
+    bool Result = false;
+    struct sockaddr_in Address;
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port   = htons(Port);
+
+    if ((m_Fd < 0) && (inet_pton(AF_INET, HostPtr, &Address.sin_addr) == 1))
+    {
+        m_Fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_Fd >= 0)
+        {
+            if ((connect(m_Fd, (struct sockaddr*)&Address, sizeof(Address)) == 0)
+                && (m_ExecutorPtr->Add(m_Fd, &m_Poll) == true))
+            {
+                Result = true;
+            }
+            else
+            {
+                close(m_Fd);
+                m_Fd = -1;
+            }
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Close()
+{
+    Z21Wait* ReadyPtr   = NULL;
+    Z21Wait** ReadyLast = &ReadyPtr;
+    Z21Wait* WaitPtr;
+    uint8_t Index;
+
+    if (m_Fd >= 0)
+    {
+        m_ExecutorPtr->Remove(m_Fd);
+        close(m_Fd);
+        m_Fd = -1;
+
+        for (Index = 0; Index <= Z21_CLIENT_LOC_LISTS; Index++)
+        {
+            WaitPtr = (Index < Z21_CLIENT_LOC_LISTS) ? m_LocWaitPtr[Index] : m_CvWaitPtr;
+            while (WaitPtr != NULL)
+            {
+                m_ExecutorPtr->Erase(WaitPtr);
+                Unlink(WaitPtr);
+                WaitPtr->m_Status = z21StatusTimeout;
+                *ReadyLast        = WaitPtr;
+                ReadyLast         = &WaitPtr->m_NextPtr;
+                WaitPtr           = (Index < Z21_CLIENT_LOC_LISTS) ? m_LocWaitPtr[Index] : m_CvWaitPtr;
+            }
+        }
+        *ReadyLast = NULL;
+
+        Resume(ReadyPtr);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+Z21Slave* Z21Client::Slave() { return (&m_Slave); }
+
+/***********************************************************************************************************************
+ */
+bool Z21Client::Transmit()
+{
+    bool Result = false;
+    uint16_t Length;
+
+    if ((m_Fd >= 0) && (m_Slave.txDataPresent() == true))
+    {
+        // A request lost here is completed by its timeout.
+        Length = m_Slave.GetDataTxLength();
+        Result = (send(m_Fd, m_Slave.GetDataTx(), Length, 0) == (ssize_t)Length);
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+Z21CvRead Z21Client::ReadCv(uint16_t CvNumber, uint32_t Timeout) { return (Z21CvRead(this, CvNumber, Timeout)); }
+
+/***********************************************************************************************************************
+ */
+Z21LocInfoGet Z21Client::GetLocoInfo(uint16_t Address, uint32_t Timeout)
+{
+    return (Z21LocInfoGet(this, Address, Timeout));
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Ready(void* ArgPtr) { ((Z21Client*)ArgPtr)->Receive(); }
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Receive()
+{
+    uint8_t Buffer[Z21_CLIENT_DATAGRAM_SIZE];
+    ssize_t Length;
+    uint16_t Offset;
+    Z21Slave::dataType Type;
+
+    // The socket is non blocking, read until all received datagrams are handled. A resumed coroutine may close it.
+    while (m_Fd >= 0)
+    {
+        Length = recv(m_Fd, Buffer, sizeof(Buffer), 0);
+        if (Length < 0)
+        {
+            break;
+        }
+
+        Offset = 0;
+        while (Offset < (uint16_t)Length)
+        {
+            Type = m_Slave.ProcesDataRx(Buffer, (uint16_t)Length, &Offset);
+            Resume(Complete(Type));
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Request(Z21Wait* WaitPtr)
+{
+    uint8_t List;
+
+    switch (WaitPtr->m_Type)
+    {
+    case Z21Slave::programmingCvResult:
+        m_Slave.LanCvRead(WaitPtr->m_Key);
+        Append(WaitPtr, &m_CvWaitPtr, &m_CvWaitLastPtr);
+        break;
+    case Z21Slave::locinfo:
+        List = WaitPtr->m_Key % Z21_CLIENT_LOC_LISTS;
+        m_Slave.LanXGetLocoInfo(WaitPtr->m_Key);
+        Append(WaitPtr, &m_LocWaitPtr[List], &m_LocWaitLastPtr[List]);
+        break;
+    default: break;
+    }
+
+    Transmit();
+}
+
+/***********************************************************************************************************************
+ */
+Z21Wait* Z21Client::Complete(Z21Slave::dataType Type)
+{
+    Z21Wait* ReadyPtr   = NULL;
+    Z21Wait** ReadyLast = &ReadyPtr;
+    Z21Wait* WaitPtr    = NULL;
+    Z21Wait* NextPtr;
+    Z21Slave::locInfo* LocInfoPtr;
+    Z21Slave::cvData* CvDataPtr;
+
+    switch (Type)
+    {
+    case Z21Slave::locinfo:
+        // The loc info is a broadcast, it completes all requests of the loc.
+        LocInfoPtr = m_Slave.LanXLocoInfo();
+        WaitPtr    = m_LocWaitPtr[LocInfoPtr->Address % Z21_CLIENT_LOC_LISTS];
+        while (WaitPtr != NULL)
+        {
+            NextPtr = WaitPtr->m_NextPtr;
+            if (WaitPtr->m_Key == LocInfoPtr->Address)
+            {
+                m_ExecutorPtr->Erase(WaitPtr);
+                Unlink(WaitPtr);
+                WaitPtr->m_Status  = z21StatusOk;
+                WaitPtr->m_LocInfo = *LocInfoPtr;
+                *ReadyLast         = WaitPtr;
+                ReadyLast          = &WaitPtr->m_NextPtr;
+            }
+            WaitPtr = NextPtr;
+        }
+        break;
+    case Z21Slave::programmingCvResult:
+        // The Z21 reads one CV after the other, the oldest read of the CV gets the result.
+        CvDataPtr = m_Slave.LanXCvResult();
+        WaitPtr   = m_CvWaitPtr;
+        while ((WaitPtr != NULL) && (WaitPtr->m_Key != CvDataPtr->Number))
+        {
+            WaitPtr = WaitPtr->m_NextPtr;
+        }
+        if (WaitPtr != NULL)
+        {
+            WaitPtr->m_Status  = z21StatusOk;
+            WaitPtr->m_CvValue = CvDataPtr->Value;
+        }
+        break;
+    case Z21Slave::programmingCvNackSc:
+        // The NACK does not hold the CV number, it belongs to the oldest read.
+        WaitPtr = m_CvWaitPtr;
+        if (WaitPtr != NULL)
+        {
+            WaitPtr->m_Status = z21StatusNack;
+        }
+        break;
+    default: break;
+    }
+
+    if ((Type != Z21Slave::locinfo) && (WaitPtr != NULL))
+    {
+        m_ExecutorPtr->Erase(WaitPtr);
+        Unlink(WaitPtr);
+        *ReadyLast = WaitPtr;
+        ReadyLast  = &WaitPtr->m_NextPtr;
+    }
+    *ReadyLast = NULL;
+
+    return (ReadyPtr);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Resume(Z21Wait* WaitPtr)
+{
+    Z21Wait* NextPtr;
+
+    // The frame with the request is gone when the coroutine ends, so the next request is read before.
+    while (WaitPtr != NULL)
+    {
+        NextPtr = WaitPtr->m_NextPtr;
+        WaitPtr->m_Handle.resume();
+        WaitPtr = NextPtr;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Append(Z21Wait* WaitPtr, Z21Wait** ListPtr, Z21Wait** ListLastPtr)
+{
+    WaitPtr->m_ListPtr     = ListPtr;
+    WaitPtr->m_ListLastPtr = ListLastPtr;
+    WaitPtr->m_PrevPtr     = *ListLastPtr;
+    WaitPtr->m_NextPtr     = NULL;
+
+    if (*ListLastPtr != NULL)
+    {
+        (*ListLastPtr)->m_NextPtr = WaitPtr;
+    }
+    else
+    {
+        *ListPtr = WaitPtr;
+    }
+    *ListLastPtr = WaitPtr;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Client::Unlink(Z21Wait* WaitPtr)
+{
+    if (WaitPtr->m_PrevPtr != NULL)
+    {
+        WaitPtr->m_PrevPtr->m_NextPtr = WaitPtr->m_NextPtr;
+    }
+    else
+    {
+        *WaitPtr->m_ListPtr = WaitPtr->m_NextPtr;
+    }
+
+    if (WaitPtr->m_NextPtr != NULL)
+    {
+        WaitPtr->m_NextPtr->m_PrevPtr = WaitPtr->m_PrevPtr;
+    }
+    else
+    {
+        *WaitPtr->m_ListLastPtr = WaitPtr->m_PrevPtr;
+    }
+
+    WaitPtr->m_PrevPtr = NULL;
+    WaitPtr->m_NextPtr = NULL;
+}
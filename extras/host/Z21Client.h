@@ -0,0 +1,363 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21Client.h
+ * @brief Awaitable Z21 requests for Linux hosts, built with C++20 coroutines. A Z21Client owns a UDP socket and a
+ *        Z21Slave, a Z21Executor runs the coroutines of all clients in one thread on epoll:
+ *
+ *          Z21Task Read(Z21Client* ClientPtr)
+ *          {
+ *              z21CvResult Cv = co_await ClientPtr->ReadCv(29);
+ *          }
+ *
+ *        The request is composed by the Z21Slave, the coroutine resumes when the response is decoded or the timeout
+ *        expires. A pending request is the awaitable in the coroutine frame and the frames come from a fixed pool
+ *        reserved with Z21Task::Reserve(), so no memory is allocated per operation.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_CLIENT_H
+#define Z21_CLIENT_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include <Arduino.h>
+#include <coroutine>
+#include <stddef.h>
+
+/***********************************************************************************************************************
+ * D E F I N E S
+ **********************************************************************************************************************/
+#define Z21_CLIENT_PORT 21105         //!< UDP port of the Z21.
+#define Z21_CLIENT_TIMEOUT 1000       //!< Default timeout of a request in ms.
+#define Z21_CLIENT_LOC_LISTS 64       //!< Lists of pending loc info requests, selected by the loc address.
+#define Z21_CLIENT_DATAGRAM_SIZE 1472 //!< Largest received datagram.
+#define Z21_EXECUTOR_EVENTS 64        //!< Epoll events handled per wait.
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+/**
+ * Status of a completed request.
+ */
+enum z21Status
+{
+    z21StatusOk = 0,
+    z21StatusTimeout,
+    z21StatusNack, /* The Z21 could not read the CV. */
+    z21StatusBusy, /* Too many pending requests in the executor. */
+};
+
+/**
+ * Result of ReadCv.
+ */
+struct z21CvResult
+{
+    z21Status Status;
+    uint16_t Number;
+    uint8_t Value;
+};
+
+/**
+ * Result of GetLocoInfo.
+ */
+struct z21LocInfoResult
+{
+    z21Status Status;
+    Z21Slave::locInfo LocInfo;
+};
+
+/**
+ * File descriptor watched by the executor, the function is called with the argument when it is readable.
+ */
+struct z21Poll
+{
+    void (*ReadyFunc)(void* ArgPtr);
+    void* ArgPtr;
+};
+
+class Z21Client;
+class Z21Executor;
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+
+/**
+ * Detached coroutine, started at the call and destroyed at the end. The frame is taken from the pool, when the pool
+ * is empty the coroutine is not started and Started() returns false.
+ */
+class Z21Task
+{
+public:
+    struct promise_type
+    {
+        Z21Task get_return_object() { return (Z21Task(true)); }
+        static Z21Task get_return_object_on_allocation_failure() { return (Z21Task(false)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { abort(); }
+        static void* operator new(size_t Size) noexcept;
+        static void operator delete(void* FramePtr);
+    };
+
+    /**
+     * Reserve the pool for the coroutine frames, once before the first task.
+     */
+    static bool Reserve(uint16_t Frames, uint16_t FrameSize);
+
+    /**
+     * Check if the coroutine got a frame and runs.
+     */
+    bool Started();
+
+private:
+    bool m_Started; /* Frame taken from the pool. */
+
+    explicit Z21Task(bool Started);
+};
+
+/**
+ * Pending request, the awaitables of the requests are derived from it.
+ */
+class Z21Wait
+{
+public:
+    bool await_ready() { return (false); }
+    bool await_suspend(std::coroutine_handle<> Handle);
+
+protected:
+    Z21Client* m_ClientPtr;      /* Client of the request. */
+    Z21Slave::dataType m_Type;   /* Expected response. */
+    uint16_t m_Key;              /* Loc address or CV number of the response. */
+    uint32_t m_Timeout;          /* Timeout in ms. */
+    z21Status m_Status;          /* Status when completed. */
+    uint8_t m_CvValue;           /* Received CV value. */
+    Z21Slave::locInfo m_LocInfo; /* Received loc info. */
+
+    Z21Wait(Z21Client* ClientPtr, Z21Slave::dataType Type, uint16_t Key, uint32_t Timeout);
+
+private:
+    std::coroutine_handle<> m_Handle; /* Coroutine to resume. */
+    uint32_t m_Deadline;              /* Time of the timeout in ms. */
+    uint16_t m_HeapIndex;             /* Position in the timeout heap of the executor. */
+    Z21Wait* m_PrevPtr;               /* Previous request in the list of the client. */
+    Z21Wait* m_NextPtr;               /* Next request in the list of the client, or the next completed request. */
+    Z21Wait** m_ListPtr;              /* First request of the list the request is in. */
+    Z21Wait** m_ListLastPtr;          /* Last request of the list the request is in. */
+
+    friend class Z21Client;
+    friend class Z21Executor;
+};
+
+/**
+ * co_await Client.ReadCv(), 6.1 LAN_X_CV_READ.
+ */
+class Z21CvRead : public Z21Wait
+{
+public:
+    Z21CvRead(Z21Client* ClientPtr, uint16_t CvNumber, uint32_t Timeout);
+    z21CvResult await_resume();
+};
+
+/**
+ * co_await Client.GetLocoInfo(), 4.1 LAN_X_GET_LOCO_INFO.
+ */
+class Z21LocInfoGet : public Z21Wait
+{
+public:
+    Z21LocInfoGet(Z21Client* ClientPtr, uint16_t Address, uint32_t Timeout);
+    z21LocInfoResult await_resume();
+};
+
+/**
+ * Single threaded executor, waits with epoll for received data and for the first timeout.
+ */
+class Z21Executor
+{
+public:
+    /**
+     * Constructor.
+     */
+    Z21Executor();
+
+    /**
+     * Destructor.
+     */
+    ~Z21Executor();
+
+    /**
+     * Create the epoll instance and the timeout heap for the maximum number of pending requests.
+     */
+    bool Init(uint16_t MaxWaits);
+
+    /**
+     * Watch a file descriptor, the poll data must stay valid until Remove().
+     */
+    bool Add(int Fd, z21Poll* PollPtr);
+
+    /**
+     * Stop watching a file descriptor.
+     */
+    void Remove(int Fd);
+
+    /**
+     * Handle received data and timeouts until no request is pending or Stop() is called.
+     */
+    void Run();
+
+    /**
+     * Wait once for received data or the first timeout, at most the given time in ms.
+     */
+    void RunOnce(uint32_t MaxWait);
+
+    /**
+     * Let Run() return.
+     */
+    void Stop();
+
+    /**
+     * Number of pending requests.
+     */
+    uint16_t Pending();
+
+    /**
+     * Monotonic time in ms.
+     */
+    uint32_t Now();
+
+private:
+    int m_EpollFd;       /* Epoll instance. */
+    Z21Wait** m_HeapPtr; /* Pending requests, ordered by deadline. */
+    uint16_t m_HeapSize; /* Number of pending requests. */
+    uint16_t m_HeapMax;  /* Maximum number of pending requests. */
+    bool m_Stop;         /* Stop Run(). */
+
+    /**
+     * Add a request to the timeout heap, false when the heap is full.
+     */
+    bool Insert(Z21Wait* WaitPtr);
+
+    /**
+     * Remove a request from the timeout heap.
+     */
+    void Erase(Z21Wait* WaitPtr);
+
+    /**
+     * Move the request at the index up or down to its place.
+     */
+    void Place(uint16_t Index);
+
+    /**
+     * Store a request in the heap at the index.
+     */
+    void Set(uint16_t Index, Z21Wait* WaitPtr);
+
+    /**
+     * Complete the requests of which the timeout expired.
+     */
+    void Expire();
+
+    friend class Z21Wait;
+    friend class Z21Client;
+};
+
+/**
+ * Connection to one Z21, the requests are composed and the responses decoded by the Z21Slave.
+ */
+class Z21Client
+{
+public:
+    /**
+     * Constructor.
+     */
+    Z21Client(Z21Executor* ExecutorPtr);
+
+    /**
+     * Destructor.
+     */
+    ~Z21Client();
+
+    /**
+     * Open the UDP socket to the Z21 and watch it in the executor.
+     */
+    bool Open(const char* HostPtr, uint16_t Port = Z21_CLIENT_PORT);
+
+    /**
+     * Close the socket, the pending requests are completed with a timeout.
+     */
+    void Close();
+
+    /**
+     * The Z21Slave, for requests which are not awaited.
+     */
+    Z21Slave* Slave();
+
+    /**
+     * Transmit the message composed by the Z21Slave.
+     */
+    bool Transmit();
+
+    /**
+     * Read a CV on the programming track.
+     */
+    Z21CvRead ReadCv(uint16_t CvNumber, uint32_t Timeout = Z21_CLIENT_TIMEOUT);
+
+    /**
+     * Get the loc info of a loc.
+     */
+    Z21LocInfoGet GetLocoInfo(uint16_t Address, uint32_t Timeout = Z21_CLIENT_TIMEOUT);
+
+private:
+    Z21Executor* m_ExecutorPtr;                      /* Executor of the coroutines. */
+    Z21Slave m_Slave;                                /* Composes requests and decodes responses. */
+    int m_Fd;                                        /* UDP socket connected to the Z21. */
+    z21Poll m_Poll;                                  /* Receive handler in the executor. */
+    Z21Wait* m_CvWaitPtr;                            /* Pending CV reads, oldest first. */
+    Z21Wait* m_CvWaitLastPtr;                        /* Last pending CV read. */
+    Z21Wait* m_LocWaitPtr[Z21_CLIENT_LOC_LISTS];     /* Pending loc info requests per list. */
+    Z21Wait* m_LocWaitLastPtr[Z21_CLIENT_LOC_LISTS]; /* Last pending loc info request per list. */
+
+    /**
+     * Receive handler of the executor.
+     */
+    static void Ready(void* ArgPtr);
+
+    /**
+     * Read all received datagrams and complete the requests of the responses.
+     */
+    void Receive();
+
+    /**
+     * Compose and transmit the request and add it to the list of pending requests.
+     */
+    void Request(Z21Wait* WaitPtr);
+
+    /**
+     * Remove the requests matching a decoded response from their list and link them for Resume().
+     */
+    Z21Wait* Complete(Z21Slave::dataType Type);
+
+    /**
+     * Resume the coroutines of the completed requests.
+     */
+    static void Resume(Z21Wait* WaitPtr);
+
+    /**
+     * Append a request to a list.
+     */
+    static void Append(Z21Wait* WaitPtr, Z21Wait** ListPtr, Z21Wait** ListLastPtr);
+
+    /**
+     * Remove a request from its list.
+     */
+    static void Unlink(Z21Wait* WaitPtr);
+
+    friend class Z21Wait;
+    friend class Z21Executor;
+};
+
+#endif
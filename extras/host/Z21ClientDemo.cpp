@@ -0,0 +1,252 @@
+/***********************************************************************************************************************
+   @file   Z21ClientDemo.cpp
+   @brief  Thousands of concurrent awaited requests in one thread. Simulated Z21 stations on the loopback interface
+           answer LAN_X_GET_LOCO_INFO and LAN_X_CV_READ, one loc address is never answered to show the timeout and
+           one CV is answered with a NACK. Each coroutine gets the loc info of a loc and then reads a CV, the results
+           are checked against the simulated stations.
+
+   Build and run:
+     g++ -std=c++20 -O2 -Iextras/host -I. extras/host/Z21ClientDemo.cpp extras/host/Z21Client.cpp Z21*.cpp
+     ./a.out
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Client.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+#define DEMO_STATIONS 64         //!< Simulated Z21 stations, each with one client.
+#define DEMO_OPERATIONS 64       //!< Coroutines per client.
+#define DEMO_FRAME_SIZE 512      //!< Size of a coroutine frame in the pool.
+#define DEMO_TIMEOUT 200         //!< Timeout of the requests in ms.
+#define DEMO_SILENT_ADDRESS 9999 //!< Loc address the stations do not answer.
+#define DEMO_NACK_CV 1000        //!< CV the stations answer with a NACK.
+
+/**
+ * Simulated Z21 station.
+ */
+typedef struct
+{
+    int Fd;
+    uint16_t Port;
+    z21Poll Poll;
+} station;
+
+static Z21Executor Executor;
+static station Stations[DEMO_STATIONS];
+static Z21Client* Clients[DEMO_STATIONS];
+static uint32_t Completed = 0;
+static uint32_t Failed    = 0;
+static uint32_t Timeouts  = 0;
+static uint32_t Nacks     = 0;
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Milliseconds for Z21Slave.
+ */
+unsigned long millis() { return (Executor.Now()); }
+
+/***********************************************************************************************************************
+ * Complete an X-Bus message with DataLen, header and XOR byte and transmit it.
+ */
+static void StationTransmit(
+    station* StationPtr, uint8_t* DataPtr, uint8_t Length, struct sockaddr_in* AddressPtr, socklen_t AddressLength)
+{
+    uint8_t Index;
+    uint8_t Checksum = 0;
+
+    DataPtr[0] = Length;
+    DataPtr[1] = 0x00;
+    DataPtr[2] = 0x40;
+    DataPtr[3] = 0x00;
+    for (Index = 4; Index < (Length - 1); Index++)
+    {
+        Checksum ^= DataPtr[Index];
+    }
+    DataPtr[Length - 1] = Checksum;
+
+    sendto(StationPtr->Fd, DataPtr, Length, 0, (struct sockaddr*)AddressPtr, AddressLength);
+}
+
+/***********************************************************************************************************************
+ * Answer the received requests of a station.
+ */
+static void StationReady(void* ArgPtr)
+{
+    station* StationPtr = (station*)ArgPtr;
+    uint8_t Request[64];
+    uint8_t Response[16];
+    struct sockaddr_in Address;
+    socklen_t AddressLength = sizeof(Address);
+    ssize_t Length;
+    uint16_t Value;
+
+    while ((Length = recvfrom(StationPtr->Fd, Request, sizeof(Request), 0, (struct sockaddr*)&Address, &AddressLength))
+        >= 9)
+    {
+        Value = ((uint16_t)(Request[6]) << 8) | Request[7];
+
+        if ((Request[4] == 0xE3) && (Request[5] == 0xF0))
+        {
+            // LAN_X_GET_LOCO_INFO, 128 speed steps and the speed taken from the address.
+            if ((Value & 0x3FFF) != DEMO_SILENT_ADDRESS)
+            {
+                Response[4]  = 0xEF;
+                Response[5]  = Request[6];
+                Response[6]  = Request[7];
+                Response[7]  = 0x04;
+                Response[8]  = 0x80 | (Value & 0x7F);
+                Response[9]  = 0x10;
+                Response[10] = 0x00;
+                Response[11] = 0x00;
+                Response[12] = 0x00;
+                StationTransmit(StationPtr, Response, 14, &Address, AddressLength);
+            }
+        }
+        else if ((Request[4] == 0x23) && (Request[5] == 0x11))
+        {
+            // LAN_X_CV_READ, the value is the low byte of the CV number.
+            if ((Value + 1) == DEMO_NACK_CV)
+            {
+                Response[4] = 0x61;
+                Response[5] = 0x13;
+                StationTransmit(StationPtr, Response, 7, &Address, AddressLength);
+            }
+            else
+            {
+                Response[4] = 0x64;
+                Response[5] = 0x14;
+                Response[6] = Request[6];
+                Response[7] = Request[7];
+                Response[8] = (Value + 1) & 0xFF;
+                StationTransmit(StationPtr, Response, 10, &Address, AddressLength);
+            }
+        }
+        AddressLength = sizeof(Address);
+    }
+}
+
+/***********************************************************************************************************************
+ * Open a station on a free port of the loopback interface.
+ */
+static bool StationOpen(station* StationPtr)
+{
+    bool Result = false;
+    struct sockaddr_in Address;
+    socklen_t AddressLength = sizeof(Address);
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family      = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    StationPtr->Fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if ((StationPtr->Fd >= 0) && (bind(StationPtr->Fd, (struct sockaddr*)&Address, sizeof(Address)) == 0)
+        && (getsockname(StationPtr->Fd, (struct sockaddr*)&Address, &AddressLength) == 0))
+    {
+        StationPtr->Port           = ntohs(Address.sin_port);
+        StationPtr->Poll.ReadyFunc = StationReady;
+        StationPtr->Poll.ArgPtr    = StationPtr;
+        Result                     = Executor.Add(StationPtr->Fd, &StationPtr->Poll);
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * One operation, get the loc info of a loc and read a CV.
+ */
+static Z21Task Operation(Z21Client* ClientPtr, uint16_t Index)
+{
+    uint16_t Address  = ((Index % 16) == 15) ? DEMO_SILENT_ADDRESS : (3 + Index);
+    uint16_t CvNumber = ((Index % 16) == 7) ? DEMO_NACK_CV : (1 + Index);
+
+    z21LocInfoResult LocInfo = co_await ClientPtr->GetLocoInfo(Address, DEMO_TIMEOUT);
+    if (LocInfo.Status == z21StatusTimeout)
+    {
+        Timeouts++;
+        Failed += (Address != DEMO_SILENT_ADDRESS);
+    }
+    else
+    {
+        Failed += (LocInfo.Status != z21StatusOk) || (LocInfo.LocInfo.Address != Address)
+            || (LocInfo.LocInfo.Speed != (Address & 0x7F)) || (LocInfo.LocInfo.Light != Z21Slave::locLightOn);
+    }
+
+    z21CvResult Cv = co_await ClientPtr->ReadCv(CvNumber, DEMO_TIMEOUT);
+    if (Cv.Status == z21StatusNack)
+    {
+        Nacks++;
+        Failed += (CvNumber != DEMO_NACK_CV);
+    }
+    else
+    {
+        Failed += (Cv.Status != z21StatusOk) || (Cv.Number != CvNumber) || (Cv.Value != (CvNumber & 0xFF));
+    }
+
+    Completed++;
+}
+
+/***********************************************************************************************************************
+ */
+int main()
+{
+    uint16_t Station;
+    uint16_t Index;
+    uint32_t Started    = 0;
+    uint32_t Operations = DEMO_STATIONS * DEMO_OPERATIONS;
+    uint32_t Start;
+
+    if ((Executor.Init(Operations) == false) || (Z21Task::Reserve(Operations, DEMO_FRAME_SIZE) == false))
+    {
+        printf("Init failed\n");
+        return (1);
+    }
+
+    for (Station = 0; Station < DEMO_STATIONS; Station++)
+    {
+        Clients[Station] = new Z21Client(&Executor);
+        if ((StationOpen(&Stations[Station]) == false)
+            || (Clients[Station]->Open("127.0.0.1", Stations[Station].Port) == false))
+        {
+            printf("Open of station %u failed\n", Station);
+            return (1);
+        }
+    }
+
+    // All operations are started before the executor runs, so all requests are pending at the same time.
+    Start = Executor.Now();
+    for (Index = 0; Index < DEMO_OPERATIONS; Index++)
+    {
+        for (Station = 0; Station < DEMO_STATIONS; Station++)
+        {
+            Started += Operation(Clients[Station], Index).Started();
+        }
+    }
+    printf("%u operations started, %u requests pending\n", Started, Executor.Pending());
+
+    Executor.Run();
+
+    printf("%u completed in %u ms, %u timeouts, %u NACKs, %u failed\n", Completed, Executor.Now() - Start, Timeouts,
+        Nacks, Failed);
+
+    for (Station = 0; Station < DEMO_STATIONS; Station++)
+    {
+        delete Clients[Station];
+        close(Stations[Station].Fd);
+    }
+
+    return (((Started == Operations) && (Completed == Operations) && (Failed == 0)) ? 0 : 1);
+}
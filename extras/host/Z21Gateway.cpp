@@ -0,0 +1,827 @@
+/***********************************************************************************************************************
+   @file   Z21Gateway.cpp
+   @brief  Gateway to more Z21 command stations implementation.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Gateway.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+/***********************************************************************************************************************
+   F O R W A R D  D E C L A R A T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+/**
+ * Kind of file descriptor in the epoll data, the station number is in the low byte.
+ */
+enum gatewayPoll
+{
+    gatewayPollClient  = 0x100,
+    gatewayPollInbox   = 0x200,
+    gatewayPollStop    = 0x300,
+    gatewayPollSession = 0x400,
+};
+
+static const uint8_t LanLogoff[4] = { 0x04, 0x00, 0x30, 0x00 }; /* LAN_LOGOFF, passed to the other shards. */
+
+/***********************************************************************************************************************
+   C O N S T R U C T O R
+ **********************************************************************************************************************/
+
+Z21GatewayShard::Z21GatewayShard()
+{
+    uint8_t Index;
+
+    m_Shard          = 0;
+    m_NrOfShards     = 1;
+    m_EpollFd        = -1;
+    m_ClientFd       = -1;
+    m_InboxFd        = -1;
+    m_StopFd         = -1;
+    m_NrOfClients    = 0;
+    m_NrOfStations   = 0;
+    m_BroadcastFlags = 0;
+
+    for (Index = 0; Index < Z21_GATEWAY_STATIONS_MAX; Index++)
+    {
+        m_Sessions[Index] = NULL;
+    }
+    for (Index = 0; Index < Z21_GATEWAY_SHARDS_MAX; Index++)
+    {
+        m_Outbox[Index].Count = 0;
+    }
+    memset(m_Inboxes, 0, sizeof(m_Inboxes));
+}
+
+/***********************************************************************************************************************
+ */
+Z21GatewayShard::~Z21GatewayShard()
+{
+    uint8_t Index;
+    int* FdPtr[4] = { &m_EpollFd, &m_ClientFd, &m_InboxFd, &m_StopFd };
+
+    for (Index = 0; Index < Z21_GATEWAY_STATIONS_MAX; Index++)
+    {
+        if (m_Sessions[Index] != NULL)
+        {
+            if (m_Sessions[Index]->Fd >= 0)
+            {
+                close(m_Sessions[Index]->Fd);
+            }
+            delete m_Sessions[Index];
+        }
+    }
+    for (Index = 0; Index < 4; Index++)
+    {
+        if (*FdPtr[Index] >= 0)
+        {
+            close(*FdPtr[Index]);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+Z21Gateway::Z21Gateway()
+{
+    uint8_t Index;
+
+    m_NrOfStations   = 0;
+    m_BroadcastFlags = 0;
+    m_NrOfShards     = 0;
+
+    for (Index = 0; Index < Z21_GATEWAY_SHARDS_MAX; Index++)
+    {
+        m_Shards[Index] = NULL;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+Z21Gateway::~Z21Gateway()
+{
+    uint8_t Index;
+
+    for (Index = 0; Index < m_NrOfShards; Index++)
+    {
+        delete m_Shards[Index];
+    }
+}
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+static bool GatewayPollAdd(int EpollFd, int Fd, uint32_t Tag)
+{
+    struct epoll_event Event;
+
+    Event.events   = EPOLLIN;
+    Event.data.u64 = Tag;
+
+    return (epoll_ctl(EpollFd, EPOLL_CTL_ADD, Fd, &Event) == 0);
+}
+
+/***********************************************************************************************************************
+ */
+static int GatewaySocket(uint32_t Address, uint16_t Port, bool ReusePort)
+{
+    int Fd;
+    int Option = 1;
+    int Buffer = 1 << 20;
+    struct sockaddr_in Local;
+
+    memset(&Local, 0, sizeof(Local));
+    Local.sin_family      = AF_INET;
+    Local.sin_addr.s_addr = htonl(Address);
+    Local.sin_port        = htons(Port);
+
+    Fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (Fd >= 0)
+    {
+        // The larger receive buffer is a hint, the kernel limits it.
+        setsockopt(Fd, SOL_SOCKET, SO_RCVBUF, &Buffer, sizeof(Buffer));
+        if (((ReusePort == true) && (setsockopt(Fd, SOL_SOCKET, SO_REUSEPORT, &Option, sizeof(Option)) != 0))
+            || (bind(Fd, (struct sockaddr*)&Local, sizeof(Local)) != 0))
+        {
+            close(Fd);
+            Fd = -1;
+        }
+    }
+
+    return (Fd);
+}
+
+/***********************************************************************************************************************
+ */
+bool Z21GatewayShard::Open(uint8_t Shard, uint8_t NrOfShards, uint16_t Port, const Z21StationMap* MapPtr,
+    const struct sockaddr_in* StationsPtr, uint8_t NrOfStations, uint32_t BroadcastFlags)
+{
+    bool Result = false;
+    uint8_t Station;
+    z21GatewaySession* SessionPtr;
+    socklen_t Length = sizeof(struct sockaddr_in);
+
+    m_Shard          = Shard;
+    m_NrOfShards     = NrOfShards;
+    m_Map            = *MapPtr;
+    m_NrOfStations   = NrOfStations;
+    m_BroadcastFlags = BroadcastFlags;
+
+    m_EpollFd  = epoll_create1(EPOLL_CLOEXEC);
+    m_ClientFd = GatewaySocket(INADDR_ANY, Port, (NrOfShards > 1));
+    m_InboxFd  = GatewaySocket(INADDR_LOOPBACK, 0, false);
+    m_StopFd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if ((m_EpollFd >= 0) && (m_ClientFd >= 0) && (m_InboxFd >= 0) && (m_StopFd >= 0)
+        && (getsockname(m_InboxFd, (struct sockaddr*)&m_Inboxes[Shard], &Length) == 0)
+        && (GatewayPollAdd(m_EpollFd, m_ClientFd, gatewayPollClient) == true)
+        && (GatewayPollAdd(m_EpollFd, m_InboxFd, gatewayPollInbox) == true)
+        && (GatewayPollAdd(m_EpollFd, m_StopFd, gatewayPollStop) == true))
+    {
+        Result = true;
+
+        // The stations of this shard are Shard, Shard + NrOfShards, ...
+        for (Station = Shard; (Station < NrOfStations) && (Result == true); Station += NrOfShards)
+        {
+            SessionPtr           = new z21GatewaySession;
+            SessionPtr->Station  = Station;
+            SessionPtr->Tx.Count = 0;
+            SessionPtr->Fd       = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            m_Sessions[Station]  = SessionPtr;
+
+            Result = (SessionPtr->Fd >= 0)
+                && (connect(SessionPtr->Fd, (const struct sockaddr*)&StationsPtr[Station], sizeof(struct sockaddr_in))
+                    == 0)
+                && (GatewayPollAdd(m_EpollFd, SessionPtr->Fd, gatewayPollSession | Station) == true);
+
+            if ((Result == true) && (BroadcastFlags != 0))
+            {
+                SessionPtr->Slave.LanSetBroadCastFlags(BroadcastFlags);
+                if (SessionPtr->Slave.txDataPresent() == true)
+                {
+                    Append(&SessionPtr->Tx, SessionPtr->Fd, NULL, NULL, 0, SessionPtr->Slave.GetDataTx(),
+                        SessionPtr->Slave.GetDataTxLength(), false);
+                }
+            }
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+const struct sockaddr_in* Z21GatewayShard::Inbox() { return (&m_Inboxes[m_Shard]); }
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::SetInboxes(const struct sockaddr_in* InboxesPtr)
+{
+    memcpy(m_Inboxes, InboxesPtr, m_NrOfShards * sizeof(struct sockaddr_in));
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::Run()
+{
+    struct epoll_event Events[Z21_GATEWAY_BATCH];
+    int Count;
+    int Index;
+    uint32_t Tag;
+    uint32_t Time;
+    uint32_t LastCheck = Now();
+    bool Running       = true;
+
+    FlushAll();
+
+    while (Running == true)
+    {
+        Count = epoll_wait(m_EpollFd, Events, Z21_GATEWAY_BATCH, Z21_GATEWAY_KEEPALIVE_CHECK);
+        for (Index = 0; Index < Count; Index++)
+        {
+            Tag = (uint32_t)Events[Index].data.u64;
+            switch (Tag & 0xFF00)
+            {
+            case gatewayPollClient: ReceiveClients(); break;
+            case gatewayPollInbox: ReceiveInbox(); break;
+            case gatewayPollStop: Running = false; break;
+            case gatewayPollSession: ReceiveSession(m_Sessions[Tag & 0xFF]); break;
+            default: break;
+            }
+        }
+
+        Time = Now();
+        if ((Time - LastCheck) >= Z21_GATEWAY_KEEPALIVE_CHECK)
+        {
+            LastCheck = Time;
+            KeepAlive(Time);
+        }
+
+        // All messages routed in this pass leave with one sendmmsg per socket.
+        FlushAll();
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::Stop()
+{
+    uint64_t Value = 1;
+
+    if (write(m_StopFd, &Value, sizeof(Value)) < 0)
+    {
+        // The eventfd is already signaled.
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::ReceiveClients()
+{
+    uint16_t Length[Z21_GATEWAY_BATCH];
+    int Count;
+    int Index;
+
+    do
+    {
+        Count = ReceiveBatch(m_ClientFd, Length);
+        for (Index = 0; Index < Count; Index++)
+        {
+            Route(&m_RxAddress[Index], m_Rx[Index], Length[Index], true);
+        }
+    } while (Count == Z21_GATEWAY_BATCH);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::ReceiveInbox()
+{
+    uint16_t Length[Z21_GATEWAY_BATCH];
+    struct sockaddr_in Address;
+    int Count;
+    int Index;
+
+    do
+    {
+        Count = ReceiveBatch(m_InboxFd, Length);
+        for (Index = 0; Index < Count; Index++)
+        {
+            // Each datagram of another shard starts with the address of the client.
+            if (Length[Index] >= sizeof(Address))
+            {
+                memcpy(&Address, m_Rx[Index], sizeof(Address));
+                Route(&Address, &m_Rx[Index][sizeof(Address)], Length[Index] - sizeof(Address), false);
+            }
+        }
+    } while (Count == Z21_GATEWAY_BATCH);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::ReceiveSession(z21GatewaySession* SessionPtr)
+{
+    uint16_t Length[Z21_GATEWAY_BATCH];
+    struct mmsghdr Messages[Z21_GATEWAY_BATCH];
+    struct iovec Vectors[Z21_GATEWAY_BATCH];
+    uint16_t Offset;
+    uint8_t Client;
+    int Pending;
+    int Count;
+    int Index;
+
+    do
+    {
+        Count   = ReceiveBatch(SessionPtr->Fd, Length);
+        Pending = 0;
+
+        for (Index = 0; Index < Count; Index++)
+        {
+            Offset = 0;
+            while (Offset < Length[Index])
+            {
+                SessionPtr->Slave.ProcesDataRx(m_Rx[Index], Length[Index], &Offset);
+            }
+
+            // The datagram goes to all clients unchanged, one mmsghdr per client points to the received data.
+            for (Client = 0; Client < m_NrOfClients; Client++)
+            {
+                Vectors[Pending].iov_base = m_Rx[Index];
+                Vectors[Pending].iov_len  = Length[Index];
+                memset(&Messages[Pending], 0, sizeof(Messages[Pending]));
+                Messages[Pending].msg_hdr.msg_name    = &m_Clients[Client].Address;
+                Messages[Pending].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+                Messages[Pending].msg_hdr.msg_iov     = &Vectors[Pending];
+                Messages[Pending].msg_hdr.msg_iovlen  = 1;
+                Pending++;
+
+                if (Pending == Z21_GATEWAY_BATCH)
+                {
+                    sendmmsg(m_ClientFd, Messages, Pending, 0);
+                    Pending = 0;
+                }
+            }
+        }
+
+        // Transmit before m_Rx is read again.
+        if (Pending > 0)
+        {
+            sendmmsg(m_ClientFd, Messages, Pending, 0);
+        }
+    } while (Count == Z21_GATEWAY_BATCH);
+}
+
+/***********************************************************************************************************************
+ */
+int Z21GatewayShard::ReceiveBatch(int Fd, uint16_t* LengthPtr)
+{
+    struct mmsghdr Messages[Z21_GATEWAY_BATCH];
+    struct iovec Vectors[Z21_GATEWAY_BATCH];
+    int Count;
+    int Index;
+
+    memset(Messages, 0, sizeof(Messages));
+    for (Index = 0; Index < Z21_GATEWAY_BATCH; Index++)
+    {
+        Vectors[Index].iov_base             = m_Rx[Index];
+        Vectors[Index].iov_len              = Z21_GATEWAY_DATAGRAM_SIZE;
+        Messages[Index].msg_hdr.msg_name    = &m_RxAddress[Index];
+        Messages[Index].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        Messages[Index].msg_hdr.msg_iov     = &Vectors[Index];
+        Messages[Index].msg_hdr.msg_iovlen  = 1;
+    }
+
+    Count = recvmmsg(Fd, Messages, Z21_GATEWAY_BATCH, MSG_DONTWAIT, NULL);
+    if (Count < 0)
+    {
+        Count = 0;
+    }
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        LengthPtr[Index] = (uint16_t)Messages[Index].msg_len;
+    }
+
+    return (Count);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::Route(const struct sockaddr_in* AddressPtr, const uint8_t* DataPtr, uint16_t Length, bool Forward)
+{
+    bool Start[Z21_GATEWAY_SHARDS_MAX];
+    uint16_t Offset = 0;
+    uint16_t MessageLength;
+    uint8_t Station;
+    uint8_t Shard;
+    uint32_t Time = Now();
+    z21GatewaySession* SessionPtr;
+    z21GatewayClient* ClientPtr;
+
+    // A new client and from time to time an active client is announced to the other shards, so they forward the
+    // messages of their stations to it.
+    ClientPtr = Client(AddressPtr, Time);
+    if ((Forward == true) && (ClientPtr != NULL) && ((Time - ClientPtr->SentTime) >= Z21_GATEWAY_CLIENT_REFRESH))
+    {
+        ClientPtr->SentTime = Time;
+        Announce(AddressPtr, false);
+    }
+
+    for (Shard = 0; Shard < m_NrOfShards; Shard++)
+    {
+        Start[Shard] = true;
+    }
+
+    while (Offset < Length)
+    {
+        Station = m_Map.StationOfMessage(&DataPtr[Offset], Length - Offset, &MessageLength);
+        if (MessageLength == 0)
+        {
+            break;
+        }
+
+        if (DataPtr[Offset + 2] == 0x30)
+        {
+            // LAN_LOGOFF ends the client at the gateway, the stations only know the gateway.
+            RemoveClient(AddressPtr);
+            if (Forward == true)
+            {
+                Announce(AddressPtr, true);
+            }
+        }
+        else if (Station < m_NrOfStations)
+        {
+            Shard = Station % m_NrOfShards;
+            if (Shard == m_Shard)
+            {
+                SessionPtr = m_Sessions[Station];
+                Append(&SessionPtr->Tx, SessionPtr->Fd, NULL, NULL, 0, &DataPtr[Offset], MessageLength, false);
+            }
+            else if (Forward == true)
+            {
+                Append(&m_Outbox[Shard], m_InboxFd, &m_Inboxes[Shard], (const uint8_t*)AddressPtr,
+                    sizeof(struct sockaddr_in), &DataPtr[Offset], MessageLength, Start[Shard]);
+                Start[Shard] = false;
+            }
+        }
+
+        Offset += MessageLength;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::Append(z21GatewayBatch* BatchPtr, int Fd, const struct sockaddr_in* ToPtr,
+    const uint8_t* PrefixPtr, uint8_t PrefixLength, const uint8_t* DataPtr, uint16_t Length, bool Start)
+{
+    uint8_t Index;
+
+    // Messages are placed behind each other in a datagram like the Z21 does.
+    if ((BatchPtr->Count == 0) || (Start == true)
+        || ((BatchPtr->Length[BatchPtr->Count - 1] + Length) > Z21_GATEWAY_DATAGRAM_SIZE))
+    {
+        if (BatchPtr->Count == Z21_GATEWAY_BATCH)
+        {
+            Flush(BatchPtr, Fd, ToPtr);
+        }
+
+        Index                   = BatchPtr->Count;
+        BatchPtr->Length[Index] = PrefixLength;
+        if (PrefixLength > 0)
+        {
+            memcpy(BatchPtr->Data[Index], PrefixPtr, PrefixLength);
+        }
+        BatchPtr->Count++;
+    }
+
+    Index = BatchPtr->Count - 1;
+    if (Length > 0)
+    {
+        memcpy(&BatchPtr->Data[Index][BatchPtr->Length[Index]], DataPtr, Length);
+        BatchPtr->Length[Index] += Length;
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::Flush(z21GatewayBatch* BatchPtr, int Fd, const struct sockaddr_in* ToPtr)
+{
+    struct mmsghdr Messages[Z21_GATEWAY_BATCH];
+    struct iovec Vectors[Z21_GATEWAY_BATCH];
+    uint8_t Index;
+    int Sent = 0;
+    int Result;
+
+    memset(Messages, 0, BatchPtr->Count * sizeof(struct mmsghdr));
+    for (Index = 0; Index < BatchPtr->Count; Index++)
+    {
+        Vectors[Index].iov_base             = BatchPtr->Data[Index];
+        Vectors[Index].iov_len              = BatchPtr->Length[Index];
+        Messages[Index].msg_hdr.msg_name    = (void*)ToPtr;
+        Messages[Index].msg_hdr.msg_namelen = (ToPtr != NULL) ? sizeof(struct sockaddr_in) : 0;
+        Messages[Index].msg_hdr.msg_iov     = &Vectors[Index];
+        Messages[Index].msg_hdr.msg_iovlen  = 1;
+    }
+
+    // UDP may drop datagrams anyway, a full socket buffer drops the rest of the batch.
+    while (Sent < BatchPtr->Count)
+    {
+        Result = sendmmsg(Fd, &Messages[Sent], BatchPtr->Count - Sent, 0);
+        if (Result <= 0)
+        {
+            break;
+        }
+        Sent += Result;
+    }
+
+    BatchPtr->Count = 0;
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::FlushAll()
+{
+    uint8_t Index;
+
+    for (Index = 0; Index < m_NrOfStations; Index++)
+    {
+        if ((m_Sessions[Index] != NULL) && (m_Sessions[Index]->Tx.Count > 0))
+        {
+            Flush(&m_Sessions[Index]->Tx, m_Sessions[Index]->Fd, NULL);
+        }
+    }
+
+    for (Index = 0; Index < m_NrOfShards; Index++)
+    {
+        if ((Index != m_Shard) && (m_Outbox[Index].Count > 0))
+        {
+            Flush(&m_Outbox[Index], m_InboxFd, &m_Inboxes[Index]);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::Announce(const struct sockaddr_in* AddressPtr, bool Logoff)
+{
+    uint8_t Shard;
+
+    for (Shard = 0; Shard < m_NrOfShards; Shard++)
+    {
+        if (Shard != m_Shard)
+        {
+            Append(&m_Outbox[Shard], m_InboxFd, &m_Inboxes[Shard], (const uint8_t*)AddressPtr,
+                sizeof(struct sockaddr_in), LanLogoff, (Logoff == true) ? sizeof(LanLogoff) : 0, true);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+z21GatewayClient* Z21GatewayShard::Client(const struct sockaddr_in* AddressPtr, uint32_t Time)
+{
+    z21GatewayClient* Result = NULL;
+    uint8_t Index;
+
+    for (Index = 0; (Index < m_NrOfClients) && (Result == NULL); Index++)
+    {
+        if ((m_Clients[Index].Address.sin_addr.s_addr == AddressPtr->sin_addr.s_addr)
+            && (m_Clients[Index].Address.sin_port == AddressPtr->sin_port))
+        {
+            Result = &m_Clients[Index];
+        }
+    }
+
+    if ((Result == NULL) && (m_NrOfClients < Z21_GATEWAY_CLIENTS_MAX))
+    {
+        Result = &m_Clients[m_NrOfClients];
+        memset(Result, 0, sizeof(z21GatewayClient));
+        Result->Address.sin_family      = AF_INET;
+        Result->Address.sin_addr.s_addr = AddressPtr->sin_addr.s_addr;
+        Result->Address.sin_port        = AddressPtr->sin_port;
+        Result->SentTime                = Time - Z21_GATEWAY_CLIENT_REFRESH;
+        m_NrOfClients++;
+    }
+
+    if (Result != NULL)
+    {
+        Result->LastTime = Time;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::RemoveClient(const struct sockaddr_in* AddressPtr)
+{
+    uint8_t Index = 0;
+
+    while (Index < m_NrOfClients)
+    {
+        if ((m_Clients[Index].Address.sin_addr.s_addr == AddressPtr->sin_addr.s_addr)
+            && (m_Clients[Index].Address.sin_port == AddressPtr->sin_port))
+        {
+            m_NrOfClients--;
+            m_Clients[Index] = m_Clients[m_NrOfClients];
+        }
+        else
+        {
+            Index++;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21GatewayShard::KeepAlive(uint32_t Time)
+{
+    uint8_t Index = 0;
+    z21GatewaySession* SessionPtr;
+
+    while (Index < m_NrOfClients)
+    {
+        if ((Time - m_Clients[Index].LastTime) >= Z21_GATEWAY_CLIENT_TIMEOUT)
+        {
+            m_NrOfClients--;
+            m_Clients[Index] = m_Clients[m_NrOfClients];
+        }
+        else
+        {
+            Index++;
+        }
+    }
+
+    for (Index = 0; Index < m_NrOfStations; Index++)
+    {
+        SessionPtr = m_Sessions[Index];
+        if ((SessionPtr != NULL) && (SessionPtr->Slave.KeepAlive() == true)
+            && (SessionPtr->Slave.txDataPresent() == true))
+        {
+            Append(&SessionPtr->Tx, SessionPtr->Fd, NULL, NULL, 0, SessionPtr->Slave.GetDataTx(),
+                SessionPtr->Slave.GetDataTxLength(), false);
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ */
+uint32_t Z21GatewayShard::Now()
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return ((uint32_t)Time.tv_sec * 1000 + (uint32_t)(Time.tv_nsec / 1000000));
+}
+
+/***********************************************************************************************************************
+ */
+uint8_t Z21Gateway::AddStation(const char* HostPtr, uint16_t Port)
+{
+    uint8_t Result = Z21_STATION_NONE;
+    struct sockaddr_in* AddressPtr;
+
+    if ((m_NrOfShards == 0) && (m_NrOfStations < Z21_GATEWAY_STATIONS_MAX))
+    {
+        AddressPtr = &m_Stations[m_NrOfStations];
+        memset(AddressPtr, 0, sizeof(struct sockaddr_in));
+        AddressPtr->sin_family = AF_INET;
+        AddressPtr->sin_port   = htons(Port);
+
+        if (inet_pton(AF_INET, HostPtr, &AddressPtr->sin_addr) == 1)
+        {
+            Result = m_NrOfStations;
+            m_NrOfStations++;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+Z21StationMap* Z21Gateway::Map() { return (&m_Map); }
+
+/***********************************************************************************************************************
+ */
+void Z21Gateway::SetBroadcastFlags(uint32_t Flags) { m_BroadcastFlags = Flags; }
+
+/***********************************************************************************************************************
+ */
+bool Z21Gateway::Start(uint16_t Port, uint8_t NrOfShards)
+{
+    bool Result = false;
+    uint8_t Shard;
+    struct sockaddr_in Inboxes[Z21_GATEWAY_SHARDS_MAX];
+
+    // A shard without stations would only pass messages on.
+    if (NrOfShards > m_NrOfStations)
+    {
+        NrOfShards = m_NrOfStations;
+    }
+    if (NrOfShards > Z21_GATEWAY_SHARDS_MAX)
+    {
+        NrOfShards = Z21_GATEWAY_SHARDS_MAX;
+    }
+
+    if ((m_NrOfShards == 0) && (NrOfShards > 0))
+    {
+        Result = true;
+        for (Shard = 0; (Shard < NrOfShards) && (Result == true); Shard++)
+        {
+            m_Shards[Shard] = new Z21GatewayShard;
+            m_NrOfShards++;
+            Result = m_Shards[Shard]->Open(
+                Shard, NrOfShards, Port, &m_Map, m_Stations, m_NrOfStations, m_BroadcastFlags);
+            Inboxes[Shard] = *m_Shards[Shard]->Inbox();
+        }
+
+        // The inbox addresses are known when all shards are open, after this each shard only changes itself.
+        for (Shard = 0; (Shard < NrOfShards) && (Result == true); Shard++)
+        {
+            m_Shards[Shard]->SetInboxes(Inboxes);
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ */
+static void GatewayPin(uint8_t Shard)
+{
+    cpu_set_t Cpus;
+    long Cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (Cores > 1)
+    {
+        CPU_ZERO(&Cpus);
+        CPU_SET(Shard % Cores, &Cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(Cpus), &Cpus);
+    }
+}
+
+/***********************************************************************************************************************
+ */
+static void GatewayShardRun(Z21GatewayShard* ShardPtr, uint8_t Shard)
+{
+    GatewayPin(Shard);
+    ShardPtr->Run();
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Gateway::Run()
+{
+    std::thread* Threads[Z21_GATEWAY_SHARDS_MAX];
+    uint8_t Shard;
+
+    // Shard 0 runs in the calling thread.
+    for (Shard = 1; Shard < m_NrOfShards; Shard++)
+    {
+        Threads[Shard] = new std::thread(GatewayShardRun, m_Shards[Shard], Shard);
+    }
+
+    if (m_NrOfShards > 1)
+    {
+        GatewayPin(0);
+    }
+    if (m_NrOfShards > 0)
+    {
+        m_Shards[0]->Run();
+    }
+
+    for (Shard = 1; Shard < m_NrOfShards; Shard++)
+    {
+        Threads[Shard]->join();
+        delete Threads[Shard];
+    }
+}
+
+/***********************************************************************************************************************
+ */
+void Z21Gateway::Stop()
+{
+    uint8_t Shard;
+
+    for (Shard = 0; Shard < m_NrOfShards; Shard++)
+    {
+        m_Shards[Shard]->Stop();
+    }
+}
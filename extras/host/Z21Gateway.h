@@ -0,0 +1,266 @@
+/**
+ **********************************************************************************************************************
+ * @file  Z21Gateway.h
+ * @brief Gateway for Linux hosts. Clients like the Z21 app talk to the gateway as to one Z21, the gateway keeps one
+ *        Z21Slave session over UDP per upstream command station and routes each received message with the
+ *        Z21StationMap: messages with a loc address go to the station of the address, all others to the default
+ *        station. Everything a station transmits is forwarded to the clients.
+ *
+ *        All sockets are handled by one epoll loop, datagrams are read with recvmmsg and written with sendmmsg in
+ *        batches. In the sharded mode each shard is a thread with its own epoll loop, its own client socket on the
+ *        same port (SO_REUSEPORT) and the sessions of station Shard, Shard + Shards, ... Shards share no mutable data:
+ *        each has a copy of the map and messages for a station of another shard are passed through the inbox socket
+ *        of that shard.
+ ***********************************************************************************************************************
+ */
+
+#ifndef Z21_GATEWAY_H
+#define Z21_GATEWAY_H
+
+/***********************************************************************************************************************
+ * I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include "Z21StationMap.h"
+#include <Arduino.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/***********************************************************************************************************************
+ * D E F I N E S
+ **********************************************************************************************************************/
+#define Z21_GATEWAY_PORT 21105            //!< UDP port for the clients.
+#define Z21_GATEWAY_STATIONS_MAX 16       //!< Maximum number of upstream stations.
+#define Z21_GATEWAY_SHARDS_MAX 16         //!< Maximum number of shards.
+#define Z21_GATEWAY_CLIENTS_MAX 64        //!< Maximum number of clients.
+#define Z21_GATEWAY_BATCH 16              //!< Datagrams per recvmmsg and sendmmsg.
+#define Z21_GATEWAY_DATAGRAM_SIZE 1472    //!< Largest datagram.
+#define Z21_GATEWAY_CLIENT_TIMEOUT 60000  //!< Time in ms after which a silent client is dropped, like the Z21 does.
+#define Z21_GATEWAY_CLIENT_REFRESH 10000  //!< Time in ms after which the other shards are told a client is active.
+#define Z21_GATEWAY_KEEPALIVE_CHECK 1000  //!< Time in ms between keepalive checks of the sessions.
+
+/***********************************************************************************************************************
+ * T Y P E D E F S  /  E N U M
+ **********************************************************************************************************************/
+
+/**
+ * Datagrams collected for one sendmmsg.
+ */
+struct z21GatewayBatch
+{
+    uint8_t Data[Z21_GATEWAY_BATCH][Z21_GATEWAY_DATAGRAM_SIZE];
+    uint16_t Length[Z21_GATEWAY_BATCH];
+    uint8_t Count;
+};
+
+/**
+ * Upstream session to one station.
+ */
+struct z21GatewaySession
+{
+    Z21Slave Slave;     /* Session state, keepalive and decode of the received messages. */
+    int Fd;             /* UDP socket connected to the station. */
+    uint8_t Station;    /* Station number in the map. */
+    z21GatewayBatch Tx; /* Messages for the station. */
+};
+
+/**
+ * Client of the gateway.
+ */
+struct z21GatewayClient
+{
+    struct sockaddr_in Address;
+    uint32_t LastTime; /* Last message from the client in ms. */
+    uint32_t SentTime; /* Last time the other shards were told about the client. */
+};
+
+/***********************************************************************************************************************
+ * C L A S S E S
+ **********************************************************************************************************************/
+
+/**
+ * One epoll loop with its client socket, inbox and sessions. Only the thread running the shard uses it after Start().
+ */
+class Z21GatewayShard
+{
+public:
+    /**
+     * Constructor.
+     */
+    Z21GatewayShard();
+
+    /**
+     * Destructor.
+     */
+    ~Z21GatewayShard();
+
+    /**
+     * Open the sockets of the shard and the sessions of its stations. The map and the station addresses are copied.
+     */
+    bool Open(uint8_t Shard, uint8_t NrOfShards, uint16_t Port, const Z21StationMap* MapPtr,
+        const struct sockaddr_in* StationsPtr, uint8_t NrOfStations, uint32_t BroadcastFlags);
+
+    /**
+     * Address of the inbox socket.
+     */
+    const struct sockaddr_in* Inbox();
+
+    /**
+     * Copy the inbox addresses of all shards, before Run().
+     */
+    void SetInboxes(const struct sockaddr_in* InboxesPtr);
+
+    /**
+     * Handle datagrams until Stop().
+     */
+    void Run();
+
+    /**
+     * Let Run() return, may be called from another thread.
+     */
+    void Stop();
+
+private:
+    uint8_t m_Shard;                                            /* Number of this shard. */
+    uint8_t m_NrOfShards;                                       /* Number of shards. */
+    int m_EpollFd;                                              /* Epoll instance. */
+    int m_ClientFd;                                             /* Socket of the clients, on the gateway port. */
+    int m_InboxFd;                                              /* Socket for messages from other shards. */
+    int m_StopFd;                                               /* Eventfd to stop Run(). */
+    Z21StationMap m_Map;                                        /* Copy of the map. */
+    struct sockaddr_in m_Inboxes[Z21_GATEWAY_SHARDS_MAX];       /* Inbox addresses of all shards. */
+    z21GatewaySession* m_Sessions[Z21_GATEWAY_STATIONS_MAX];    /* Sessions by station, NULL for other shards. */
+    z21GatewayClient m_Clients[Z21_GATEWAY_CLIENTS_MAX];        /* Known clients. */
+    uint8_t m_NrOfClients;                                      /* Number of known clients. */
+    uint8_t m_NrOfStations;                                     /* Number of stations. */
+    uint32_t m_BroadcastFlags;                                  /* Broadcast flags of the sessions. */
+    z21GatewayBatch m_Outbox[Z21_GATEWAY_SHARDS_MAX];           /* Messages for the other shards. */
+    uint8_t m_Rx[Z21_GATEWAY_BATCH][Z21_GATEWAY_DATAGRAM_SIZE]; /* Received datagrams. */
+    struct sockaddr_in m_RxAddress[Z21_GATEWAY_BATCH];          /* Sources of the received datagrams. */
+
+    /**
+     * Read the datagrams of the clients and route their messages.
+     */
+    void ReceiveClients();
+
+    /**
+     * Read the datagrams of the other shards and route their messages.
+     */
+    void ReceiveInbox();
+
+    /**
+     * Read the datagrams of a station and forward them to the clients.
+     */
+    void ReceiveSession(z21GatewaySession* SessionPtr);
+
+    /**
+     * Read up to Z21_GATEWAY_BATCH datagrams into m_Rx, returns the number read.
+     */
+    int ReceiveBatch(int Fd, uint16_t* LengthPtr);
+
+    /**
+     * Route the messages of a datagram of a client, Forward is false for datagrams from the inbox.
+     */
+    void Route(const struct sockaddr_in* AddressPtr, const uint8_t* DataPtr, uint16_t Length, bool Forward);
+
+    /**
+     * Add a message to a batch, a new datagram starting with the prefix is begun when Start is true or the message
+     * does not fit. Flushes the batch to the socket when it is full.
+     */
+    void Append(z21GatewayBatch* BatchPtr, int Fd, const struct sockaddr_in* ToPtr, const uint8_t* PrefixPtr,
+        uint8_t PrefixLength, const uint8_t* DataPtr, uint16_t Length, bool Start);
+
+    /**
+     * Transmit all datagrams of a batch with sendmmsg.
+     */
+    void Flush(z21GatewayBatch* BatchPtr, int Fd, const struct sockaddr_in* ToPtr);
+
+    /**
+     * Transmit the batches of the sessions and of the other shards.
+     */
+    void FlushAll();
+
+    /**
+     * Tell the other shards about a client, Logoff removes it there.
+     */
+    void Announce(const struct sockaddr_in* AddressPtr, bool Logoff);
+
+    /**
+     * Find or add a client, returns NULL when the table is full.
+     */
+    z21GatewayClient* Client(const struct sockaddr_in* AddressPtr, uint32_t Now);
+
+    /**
+     * Remove a client.
+     */
+    void RemoveClient(const struct sockaddr_in* AddressPtr);
+
+    /**
+     * Drop silent clients and let the sessions transmit their keepalive.
+     */
+    void KeepAlive(uint32_t Now);
+
+    /**
+     * Monotonic time in ms.
+     */
+    static uint32_t Now();
+};
+
+/**
+ * Gateway with its stations, map and shards.
+ */
+class Z21Gateway
+{
+public:
+    /**
+     * Constructor.
+     */
+    Z21Gateway();
+
+    /**
+     * Destructor.
+     */
+    ~Z21Gateway();
+
+    /**
+     * Add an upstream station, the stations are numbered in the order they are added. Returns the station number
+     * or Z21_STATION_NONE.
+     */
+    uint8_t AddStation(const char* HostPtr, uint16_t Port = Z21_GATEWAY_PORT);
+
+    /**
+     * The map from loc addresses to station numbers, set up before Start().
+     */
+    Z21StationMap* Map();
+
+    /**
+     * Broadcast flags the sessions subscribe with, before Start().
+     */
+    void SetBroadcastFlags(uint32_t Flags);
+
+    /**
+     * Open the client socket on the port and the sessions. With more than one shard the stations are spread over
+     * the shards and Run() starts a thread per shard, each pinned to a core.
+     */
+    bool Start(uint16_t Port, uint8_t NrOfShards);
+
+    /**
+     * Run the shards, returns after Stop().
+     */
+    void Run();
+
+    /**
+     * Let Run() return, may be called from another thread or a signal handler.
+     */
+    void Stop();
+
+private:
+    Z21StationMap m_Map;                                     /* Map of loc addresses to stations. */
+    struct sockaddr_in m_Stations[Z21_GATEWAY_STATIONS_MAX]; /* Station addresses. */
+    uint8_t m_NrOfStations;                                  /* Number of stations. */
+    uint32_t m_BroadcastFlags;                               /* Broadcast flags of the sessions. */
+    Z21GatewayShard* m_Shards[Z21_GATEWAY_SHARDS_MAX];       /* Shards. */
+    uint8_t m_NrOfShards;                                    /* Number of shards. */
+};
+
+#endif
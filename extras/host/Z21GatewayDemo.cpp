@@ -0,0 +1,289 @@
+/***********************************************************************************************************************
+   @file   Z21GatewayDemo.cpp
+   @brief  Gateway to simulated Z21 stations on the loopback interface. Station n owns the loc addresses
+           n * 100 .. n * 100 + 99 in the map and answers LAN_X_GET_LOCO_INFO with speed n + 1, so each client checks
+           that the request was routed to the right station. The clients send datagrams with requests for locs of
+           several stations, each answer is forwarded to all clients.
+
+   Build and run with the number of shards:
+     g++ -std=c++11 -O2 -pthread -Iextras/host -I. extras/host/Z21GatewayDemo.cpp extras/host/Z21Gateway.cpp Z21*.cpp
+     ./a.out [shards] [port]
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Gateway.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+#define DEMO_STATIONS 8  //!< Simulated stations.
+#define DEMO_CLIENTS 16  //!< Clients of the gateway.
+#define DEMO_ROUNDS 200  //!< Datagrams sent by each client.
+#define DEMO_REQUESTS 8  //!< Requests in a datagram.
+#define DEMO_WAIT 1000   //!< Time in ms to wait for the answers of a round.
+
+static int StationFds[DEMO_STATIONS];
+static int StationStopFd;
+static int ClientFds[DEMO_CLIENTS];
+static Z21Gateway Gateway;
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * Milliseconds for Z21Slave.
+ */
+unsigned long millis()
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return ((unsigned long)Time.tv_sec * 1000 + (unsigned long)(Time.tv_nsec / 1000000));
+}
+
+/***********************************************************************************************************************
+ * Answer each LAN_X_GET_LOCO_INFO in a datagram of the gateway.
+ */
+static void StationAnswer(uint8_t Station)
+{
+    uint8_t Request[Z21_GATEWAY_DATAGRAM_SIZE];
+    uint8_t Response[14];
+    struct sockaddr_in Address;
+    socklen_t AddressLength = sizeof(Address);
+    ssize_t Length;
+    uint16_t Offset;
+    uint8_t Index;
+
+    while ((Length = recvfrom(StationFds[Station], Request, sizeof(Request), MSG_DONTWAIT, (struct sockaddr*)&Address,
+                &AddressLength))
+        > 0)
+    {
+        for (Offset = 0; ((Offset + 4) <= Length) && (Request[Offset] >= 4); Offset += Request[Offset])
+        {
+            if ((Request[Offset] == 9) && (Request[Offset + 2] == 0x40) && (Request[Offset + 4] == 0xE3))
+            {
+                Response[0]  = 14;
+                Response[1]  = 0x00;
+                Response[2]  = 0x40;
+                Response[3]  = 0x00;
+                Response[4]  = 0xEF;
+                Response[5]  = Request[Offset + 6];
+                Response[6]  = Request[Offset + 7];
+                Response[7]  = 0x04;
+                Response[8]  = 0x80 | (Station + 1);
+                Response[9]  = 0x00;
+                Response[10] = 0x00;
+                Response[11] = 0x00;
+                Response[12] = 0x00;
+                Response[13] = 0x00;
+                for (Index = 4; Index < 13; Index++)
+                {
+                    Response[13] ^= Response[Index];
+                }
+                sendto(StationFds[Station], Response, sizeof(Response), 0, (struct sockaddr*)&Address, AddressLength);
+            }
+        }
+        AddressLength = sizeof(Address);
+    }
+}
+
+/***********************************************************************************************************************
+ * Thread of the simulated stations.
+ */
+static void StationRun()
+{
+    struct epoll_event Event;
+    struct epoll_event Events[DEMO_STATIONS + 1];
+    int EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    int Count;
+    int Index;
+    bool Running = true;
+
+    for (Index = 0; Index <= DEMO_STATIONS; Index++)
+    {
+        Event.events   = EPOLLIN;
+        Event.data.u32 = Index;
+        epoll_ctl(EpollFd, EPOLL_CTL_ADD, (Index < DEMO_STATIONS) ? StationFds[Index] : StationStopFd, &Event);
+    }
+
+    while (Running == true)
+    {
+        Count = epoll_wait(EpollFd, Events, DEMO_STATIONS + 1, -1);
+        for (Index = 0; Index < Count; Index++)
+        {
+            if (Events[Index].data.u32 < DEMO_STATIONS)
+            {
+                StationAnswer(Events[Index].data.u32);
+            }
+            else
+            {
+                Running = false;
+            }
+        }
+    }
+
+    close(EpollFd);
+}
+
+/***********************************************************************************************************************
+ * Open a UDP socket on the loopback interface, returns the port.
+ */
+static uint16_t DemoSocket(int* FdPtr)
+{
+    struct sockaddr_in Address;
+    socklen_t AddressLength = sizeof(Address);
+    int Buffer              = 1 << 20;
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family      = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    *FdPtr = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    setsockopt(*FdPtr, SOL_SOCKET, SO_RCVBUF, &Buffer, sizeof(Buffer));
+    bind(*FdPtr, (struct sockaddr*)&Address, sizeof(Address));
+    getsockname(*FdPtr, (struct sockaddr*)&Address, &AddressLength);
+
+    return (ntohs(Address.sin_port));
+}
+
+/***********************************************************************************************************************
+ * Receive the answers of a round on a client, returns the number of wrongly routed answers.
+ */
+static uint32_t ClientReceive(int Fd, uint32_t Expected, uint32_t* ReceivedPtr)
+{
+    uint8_t Data[Z21_GATEWAY_DATAGRAM_SIZE];
+    uint32_t Wrong    = 0;
+    uint32_t Received = 0;
+    uint32_t Start    = millis();
+    uint16_t Address;
+    ssize_t Length;
+
+    while ((Received < Expected) && ((millis() - Start) < DEMO_WAIT))
+    {
+        Length = recv(Fd, Data, sizeof(Data), MSG_DONTWAIT);
+        if (Length == 14)
+        {
+            Address = (((uint16_t)(Data[5]) << 8) | Data[6]) & 0x3FFF;
+            Wrong += ((Data[8] & 0x7F) != ((Address / 100) + 1));
+            Received++;
+        }
+        else if (Length < 0)
+        {
+            usleep(100);
+        }
+    }
+
+    *ReceivedPtr += Received;
+
+    return (Wrong);
+}
+
+/***********************************************************************************************************************
+ */
+int main(int argc, char** argv)
+{
+    uint8_t Shards = (argc > 1) ? (uint8_t)atoi(argv[1]) : 4;
+    uint16_t Port  = (argc > 2) ? (uint16_t)atoi(argv[2]) : Z21_GATEWAY_PORT;
+    uint8_t Datagram[DEMO_REQUESTS * 9];
+    uint8_t SerialNumber[4] = { 0x04, 0x00, 0x10, 0x00 };
+    struct sockaddr_in GatewayAddress;
+    uint32_t Received = 0;
+    uint32_t Wrong    = 0;
+    uint32_t Start;
+    uint32_t Time;
+    uint16_t Address;
+    uint16_t Round;
+    uint8_t Station;
+    uint8_t Client;
+    uint8_t Index;
+    uint8_t* MessagePtr;
+    uint64_t Value = 1;
+
+    StationStopFd = eventfd(0, EFD_CLOEXEC);
+    for (Station = 0; Station < DEMO_STATIONS; Station++)
+    {
+        Gateway.AddStation("127.0.0.1", DemoSocket(&StationFds[Station]));
+        Gateway.Map()->Add(Station * 100, Station * 100 + 99, Station);
+    }
+    Gateway.Map()->SetDefault(0);
+
+    if (Gateway.Start(Port, Shards) == false)
+    {
+        printf("Start of the gateway on port %u failed\n", Port);
+        return (1);
+    }
+
+    std::thread StationThread(StationRun);
+    std::thread GatewayThread(&Z21Gateway::Run, &Gateway);
+
+    memset(&GatewayAddress, 0, sizeof(GatewayAddress));
+    GatewayAddress.sin_family      = AF_INET;
+    GatewayAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    GatewayAddress.sin_port        = htons(Port);
+
+    // Each client makes itself known first, so all shards forward the answers to all clients.
+    for (Client = 0; Client < DEMO_CLIENTS; Client++)
+    {
+        DemoSocket(&ClientFds[Client]);
+        sendto(ClientFds[Client], SerialNumber, sizeof(SerialNumber), 0, (struct sockaddr*)&GatewayAddress,
+            sizeof(GatewayAddress));
+    }
+    usleep(100000);
+
+    Start = millis();
+    for (Round = 0; Round < DEMO_ROUNDS; Round++)
+    {
+        for (Client = 0; Client < DEMO_CLIENTS; Client++)
+        {
+            for (Index = 0; Index < DEMO_REQUESTS; Index++)
+            {
+                Address    = (uint16_t)(rand() % (DEMO_STATIONS * 100));
+                MessagePtr = &Datagram[Index * 9];
+
+                MessagePtr[0] = 9;
+                MessagePtr[1] = 0x00;
+                MessagePtr[2] = 0x40;
+                MessagePtr[3] = 0x00;
+                MessagePtr[4] = 0xE3;
+                MessagePtr[5] = 0xF0;
+                MessagePtr[6] = (Address >= 128) ? (0xC0 | (Address >> 8)) : 0;
+                MessagePtr[7] = Address & 0xFF;
+                MessagePtr[8] = MessagePtr[4] ^ MessagePtr[5] ^ MessagePtr[6] ^ MessagePtr[7];
+            }
+            sendto(ClientFds[Client], Datagram, sizeof(Datagram), 0, (struct sockaddr*)&GatewayAddress,
+                sizeof(GatewayAddress));
+        }
+
+        for (Client = 0; Client < DEMO_CLIENTS; Client++)
+        {
+            Wrong += ClientReceive(ClientFds[Client], DEMO_CLIENTS * DEMO_REQUESTS, &Received);
+        }
+    }
+    Time = millis() - Start;
+
+    Gateway.Stop();
+    GatewayThread.join();
+    if (write(StationStopFd, &Value, sizeof(Value)) < 0)
+    {
+        return (1);
+    }
+    StationThread.join();
+
+    printf("%u shards: %u requests, %u answers of %u received in %u ms, %u wrongly routed\n", Shards,
+        DEMO_CLIENTS * DEMO_ROUNDS * DEMO_REQUESTS, Received,
+        DEMO_CLIENTS * DEMO_ROUNDS * DEMO_REQUESTS * DEMO_CLIENTS, Time, Wrong);
+
+    return (((Wrong == 0) && (Received == (DEMO_CLIENTS * DEMO_ROUNDS * DEMO_REQUESTS * DEMO_CLIENTS))) ? 0 : 1);
+}
@@ -0,0 +1,460 @@
+/***********************************************************************************************************************
+   @file   Z21SlaveBench.cpp
+   @brief  Benchmark of the receive path of Z21Slave on a host. A mix of typical received messages is decoded by:
+           - Unchecked: the decoders as they were before the validation, reading the received bytes by index without
+             any check, as the baseline.
+           - Validated: Z21Message::FramedLength and the typed message views, decoding the same fields.
+           - ProcesDataRx: the complete receive path including the loc info changes and the link supervision.
+           Both decoders fill the same structures, the results are compared before timing. The runs of the variants
+           alternate and the fastest run of each variant is reported, which filters other load on the host. The exit
+           status is 1 when Validated needs more than BENCH_LIMIT times Unchecked, the difference is the XOR and the
+           length checks which Unchecked does not do.
+
+   Build and run, with link time optimization like the Arduino builds:
+     g++ -std=c++11 -O2 -flto -Iextras/host -I. extras/host/Z21SlaveBench.cpp Z21*.cpp
+     ./a.out [rounds]
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Message.h"
+#include "Z21Slave.h"
+#include <chrono>
+#include <stdio.h>
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+#define BENCH_MESSAGES 256          //!< Number of different messages, decoded in random order.
+#define BENCH_MESSAGE_SIZE 24       //!< Largest message.
+#define BENCH_REPEAT 100            //!< Passes over all messages in one run, short runs are rarely interrupted.
+#define BENCH_ROUNDS 600            //!< Default number of runs of each variant.
+#define BENCH_LIMIT 1.20            //!< Allowed time of Validated relative to Unchecked.
+#define BENCH_LOC_ADDRESSES 24      //!< Different loc addresses in the loc info messages.
+
+/**
+ * Decoded data, filled by both decoders.
+ */
+typedef struct
+{
+    Z21Slave::locInfo LocInfo;
+    Z21Slave::systemState SystemState;
+    Z21Slave::railCom RailCom;
+    uint8_t CentralState;
+    uint8_t LocoNetOpcode;
+} decoded;
+
+static uint8_t Messages[BENCH_MESSAGES][BENCH_MESSAGE_SIZE];
+static decoded Unchecked;
+static decoded Validated;
+static Z21LocoNetMessage LocoNet;
+static Z21Slave Slave;
+
+/* Conversion table for 28 steps DCC speed to normal speed, copied from Z21Slave. */
+static const uint8_t SpeedStep28TableFromDcc[32] = { 0, 0, 1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 0, 0, 2,
+    4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28 };
+
+/* Conversion table for the speed steps in DB2 of the loc info, copied from Z21Slave. */
+static const Z21Slave::locDecoderSteps SpeedStepsFromDcc[8] = { Z21Slave::locDecoderSpeedSteps14,
+    Z21Slave::locDecoderSpeedStepsUnknown, Z21Slave::locDecoderSpeedSteps28, Z21Slave::locDecoderSpeedStepsUnknown,
+    Z21Slave::locDecoderSpeedSteps128, Z21Slave::locDecoderSpeedStepsUnknown, Z21Slave::locDecoderSpeedStepsUnknown,
+    Z21Slave::locDecoderSpeedStepsUnknown };
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+unsigned long millis() { return (0); }
+
+/***********************************************************************************************************************
+ * Create loc infos of a few locs with 14, 28 and 128 speed steps, track power changes, system states, RailCom data
+ * and LocoNet input reports, including the XOR byte and LocoNet checksum.
+ */
+static void Prepare()
+{
+    static const uint8_t StepsDcc[] = { 0, 2, 2, 4, 4, 4 };
+    uint16_t Index;
+    uint8_t Byte;
+    uint8_t Checksum;
+    uint8_t* DataPtr;
+
+    srand(1);
+
+    for (Index = 0; Index < BENCH_MESSAGES; Index++)
+    {
+        DataPtr = Messages[Index];
+        for (Byte = 0; Byte < BENCH_MESSAGE_SIZE; Byte++)
+        {
+            DataPtr[Byte] = (uint8_t)rand();
+        }
+        DataPtr[1] = 0;
+        DataPtr[3] = 0;
+
+        switch (rand() % 10)
+        {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+            DataPtr[0] = 14;
+            DataPtr[2] = 0x40;
+            DataPtr[4] = 0xEF;
+            DataPtr[5] = 0;
+            DataPtr[6] = 1 + (rand() % BENCH_LOC_ADDRESSES);
+            DataPtr[7] = StepsDcc[DataPtr[6] % sizeof(StepsDcc)] | ((rand() % 4 == 0) ? 0x08 : 0);
+            break;
+        case 4:
+        case 5:
+            DataPtr[0] = 8;
+            DataPtr[2] = 0x40;
+            DataPtr[4] = 0x62;
+            DataPtr[5] = 0x22;
+            DataPtr[6] = (rand() % 2 == 0) ? 0x00 : 0x02;
+            break;
+        case 6:
+        case 7:
+            DataPtr[0] = 20;
+            DataPtr[2] = 0x84;
+            break;
+        case 8:
+            DataPtr[0] = 17;
+            DataPtr[2] = 0x88;
+            break;
+        default:
+            DataPtr[0] = 8;
+            DataPtr[2] = 0xA0;
+            DataPtr[4] = 0xB2;
+            DataPtr[5] &= 0x7F;
+            DataPtr[6] &= 0x7F;
+            DataPtr[7] = Z21LocoNetMessage::Checksum(&DataPtr[4], 4);
+            break;
+        }
+
+        if (DataPtr[2] == 0x40)
+        {
+            Checksum = 0;
+            for (Byte = 4; Byte < (DataPtr[0] - 1); Byte++)
+            {
+                Checksum ^= DataPtr[Byte];
+            }
+            DataPtr[DataPtr[0] - 1] = Checksum;
+        }
+    }
+}
+
+/***********************************************************************************************************************
+ * The decoders before the validation, they trust DataLen and read the bytes by index.
+ */
+static Z21Slave::dataType DecodeUnchecked(const uint8_t* RxData, decoded* DecodedPtr)
+{
+    Z21Slave::dataType Result = Z21Slave::none;
+    Z21Slave::locInfo* LocInfoPtr;
+    Z21Slave::systemState* StatePtr;
+
+    switch (RxData[2])
+    {
+    case 0x40:
+        if (RxData[4] == 0xEF)
+        {
+            LocInfoPtr          = &DecodedPtr->LocInfo;
+            LocInfoPtr->Address = ((uint16_t)(RxData[5]) << 8) | RxData[6];
+            if ((LocInfoPtr->Address > 127) && ((LocInfoPtr->Address & 0xC000) == 0xC000))
+            {
+                LocInfoPtr->Address -= 0xC000;
+            }
+
+            switch (RxData[7] & 0x07)
+            {
+            case 0:
+                LocInfoPtr->Steps = Z21Slave::locDecoderSpeedSteps14;
+                LocInfoPtr->Speed = RxData[8] & 0x7F;
+                if (LocInfoPtr->Speed > 0)
+                {
+                    LocInfoPtr->Speed--;
+                }
+                break;
+            case 2:
+                LocInfoPtr->Steps = Z21Slave::locDecoderSpeedSteps28;
+                LocInfoPtr->Speed = SpeedStep28TableFromDcc[RxData[8] & 0x1F];
+                break;
+            case 4:
+                LocInfoPtr->Steps = Z21Slave::locDecoderSpeedSteps128;
+                LocInfoPtr->Speed = RxData[8] & 0x7F;
+                break;
+            default:
+                LocInfoPtr->Steps = Z21Slave::locDecoderSpeedStepsUnknown;
+                LocInfoPtr->Speed = 0;
+                break;
+            }
+
+            if (RxData[7] & 0x08)
+            {
+                LocInfoPtr->Occupied = true;
+            }
+            else
+            {
+                LocInfoPtr->Occupied = false;
+            }
+
+            if (RxData[8] & 0x80)
+            {
+                LocInfoPtr->Direction = Z21Slave::locDirectionForward;
+            }
+            else
+            {
+                LocInfoPtr->Direction = Z21Slave::locDirectionBackward;
+            }
+
+            if (RxData[9] & 0x10)
+            {
+                LocInfoPtr->Light = Z21Slave::locLightOn;
+            }
+            else
+            {
+                LocInfoPtr->Light = Z21Slave::locLightOff;
+            }
+
+            LocInfoPtr->Functions = RxData[9] & 0x0F;
+            LocInfoPtr->Functions |= (uint32_t)(RxData[10]) << 4;
+            LocInfoPtr->Functions |= (uint32_t)(RxData[11]) << 12;
+            LocInfoPtr->Functions |= (uint32_t)(RxData[12]) << 20;
+            Result = Z21Slave::locinfo;
+        }
+        else if (RxData[4] == 0x62)
+        {
+            DecodedPtr->CentralState = RxData[6];
+            Result                   = Z21Slave::trackPowerOn;
+        }
+        break;
+    case 0x84:
+        StatePtr                      = &DecodedPtr->SystemState;
+        StatePtr->MainCurrent         = (int16_t)((uint16_t)(RxData[4]) | ((uint16_t)(RxData[5]) << 8));
+        StatePtr->ProgCurrent         = (int16_t)((uint16_t)(RxData[6]) | ((uint16_t)(RxData[7]) << 8));
+        StatePtr->FilteredMainCurrent = (int16_t)((uint16_t)(RxData[8]) | ((uint16_t)(RxData[9]) << 8));
+        StatePtr->Temperature         = (int16_t)((uint16_t)(RxData[10]) | ((uint16_t)(RxData[11]) << 8));
+        StatePtr->SupplyVoltage       = (uint16_t)(RxData[12]) | ((uint16_t)(RxData[13]) << 8);
+        StatePtr->VccVoltage          = (uint16_t)(RxData[14]) | ((uint16_t)(RxData[15]) << 8);
+        StatePtr->CentralState        = RxData[16];
+        StatePtr->CentralStateEx      = RxData[17];
+        StatePtr->Capabilities        = RxData[19];
+        Result                        = Z21Slave::systemStateData;
+        break;
+    case 0x88:
+        DecodedPtr->RailCom.Address        = (uint16_t)(RxData[4]) | ((uint16_t)(RxData[5]) << 8);
+        DecodedPtr->RailCom.ReceiveCounter = (uint32_t)(RxData[6]) | ((uint32_t)(RxData[7]) << 8)
+            | ((uint32_t)(RxData[8]) << 16) | ((uint32_t)(RxData[9]) << 24);
+        DecodedPtr->RailCom.ErrorCounter   = (uint16_t)(RxData[10]) | ((uint16_t)(RxData[11]) << 8);
+        DecodedPtr->RailCom.Options        = RxData[13];
+        DecodedPtr->RailCom.Speed          = RxData[14];
+        DecodedPtr->RailCom.Qos            = RxData[15];
+        Result                             = Z21Slave::railComData;
+        break;
+    case 0xA0:
+        LocoNet.Set(&RxData[4], (uint8_t)(RxData[0] - 4));
+        DecodedPtr->LocoNetOpcode = LocoNet.Opcode();
+        Result                    = Z21Slave::locoNetRx;
+        break;
+    default: break;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * The same decode with the typed message views, like the decoders of Z21Slave.
+ */
+static Z21Slave::dataType DecodeValidated(const uint8_t* DataPtr, uint16_t Length, decoded* DecodedPtr)
+{
+    Z21Slave::dataType Result = Z21Slave::none;
+    uint8_t DataLen           = Z21Message::FramedLength(DataPtr, Length);
+    uint8_t Speed;
+    uint8_t SpeedOfSteps[4];
+    const uint8_t* Db;
+    Z21Slave::locInfo* LocInfoPtr;
+    Z21Slave::systemState* StatePtr;
+
+    switch ((DataLen != 0) ? DataPtr[2] : 0)
+    {
+    case 0x40:
+        if ((DataLen >= 6) && (DataPtr[4] == 0xEF))
+        {
+            Z21XLocInfoMessage Message(DataPtr, DataLen);
+            if (Message.Valid() == true)
+            {
+                Db                  = Message.Db2ToDb7();
+                LocInfoPtr          = &DecodedPtr->LocInfo;
+                LocInfoPtr->Address = Message.Address();
+
+                Speed                                               = Db[1] & 0x7F;
+                SpeedOfSteps[Z21Slave::locDecoderSpeedSteps14]      = Speed - (Speed != 0);
+                SpeedOfSteps[Z21Slave::locDecoderSpeedSteps28]      = SpeedStep28TableFromDcc[Speed & 0x1F];
+                SpeedOfSteps[Z21Slave::locDecoderSpeedSteps128]     = Speed;
+                SpeedOfSteps[Z21Slave::locDecoderSpeedStepsUnknown] = 0;
+
+                LocInfoPtr->Steps     = SpeedStepsFromDcc[Db[0] & 0x07];
+                LocInfoPtr->Speed     = SpeedOfSteps[LocInfoPtr->Steps];
+                LocInfoPtr->Occupied  = ((Db[0] & 0x08) != 0);
+                LocInfoPtr->Direction = (Db[1] & 0x80) ? Z21Slave::locDirectionForward : Z21Slave::locDirectionBackward;
+                LocInfoPtr->Light     = (Db[2] & 0x10) ? Z21Slave::locLightOn : Z21Slave::locLightOff;
+                LocInfoPtr->Functions = (uint32_t)(Db[2] & 0x0F) | ((uint32_t)(Db[3]) << 4)
+                    | ((uint32_t)(Db[4]) << 12) | ((uint32_t)(Db[5]) << 20);
+                Result = Z21Slave::locinfo;
+            }
+        }
+        else if ((DataLen >= 6) && (DataPtr[4] == 0x62))
+        {
+            Z21XStatusChangedMessage Message(DataPtr, DataLen);
+            if (Message.Valid() == true)
+            {
+                DecodedPtr->CentralState = Message.CentralState();
+                Result                   = Z21Slave::trackPowerOn;
+            }
+        }
+        break;
+    case 0x84:
+        {
+            Z21SystemStateMessage Message(DataPtr, DataLen);
+            if (Message.Valid() == true)
+            {
+                StatePtr                      = &DecodedPtr->SystemState;
+                StatePtr->MainCurrent         = Message.MainCurrent();
+                StatePtr->ProgCurrent         = Message.ProgCurrent();
+                StatePtr->FilteredMainCurrent = Message.FilteredMainCurrent();
+                StatePtr->Temperature         = Message.Temperature();
+                StatePtr->SupplyVoltage       = Message.SupplyVoltage();
+                StatePtr->VccVoltage          = Message.VccVoltage();
+                StatePtr->CentralState        = Message.CentralState();
+                StatePtr->CentralStateEx      = Message.CentralStateEx();
+                StatePtr->Capabilities        = Message.Capabilities();
+                Result                        = Z21Slave::systemStateData;
+            }
+        }
+        break;
+    case 0x88:
+        {
+            Z21RailComMessage Message(DataPtr, DataLen);
+            if (Message.Valid() == true)
+            {
+                DecodedPtr->RailCom.Address        = Message.Address();
+                DecodedPtr->RailCom.ReceiveCounter = Message.ReceiveCounter();
+                DecodedPtr->RailCom.ErrorCounter   = Message.ErrorCounter();
+                DecodedPtr->RailCom.Options        = Message.Options();
+                DecodedPtr->RailCom.Speed          = Message.Speed();
+                DecodedPtr->RailCom.Qos            = Message.Qos();
+                Result                             = Z21Slave::railComData;
+            }
+        }
+        break;
+    case 0xA0:
+        {
+            Z21LocoNetDataMessage Message(DataPtr, DataLen);
+            if (Message.Valid() == true)
+            {
+                LocoNet.Set(Message.LocoNetData(), Message.LocoNetLength());
+                DecodedPtr->LocoNetOpcode = LocoNet.Opcode();
+                Result                    = Z21Slave::locoNetRx;
+            }
+        }
+        break;
+    default: break;
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Check that both decoders give the same result for all messages.
+ */
+static bool Compare()
+{
+    bool Result = true;
+    uint16_t Index;
+
+    for (Index = 0; Index < BENCH_MESSAGES; Index++)
+    {
+        memset(&Unchecked, 0, sizeof(Unchecked));
+        memset(&Validated, 0, sizeof(Validated));
+
+        if ((DecodeUnchecked(Messages[Index], &Unchecked)
+                != DecodeValidated(Messages[Index], Messages[Index][0], &Validated))
+            || (memcmp(&Unchecked, &Validated, sizeof(Unchecked)) != 0))
+        {
+            printf("Message %u decoded differently\n", Index);
+            Result = false;
+        }
+    }
+
+    return (Result);
+}
+
+/***********************************************************************************************************************
+ * Time one run of a variant, returns ns per message.
+ */
+static double Run(uint8_t Variant, unsigned long* SumPtr)
+{
+    uint16_t Repeat;
+    uint16_t Index;
+    unsigned long Sum = 0;
+
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    for (Repeat = 0; Repeat < BENCH_REPEAT; Repeat++)
+    {
+        for (Index = 0; Index < BENCH_MESSAGES; Index++)
+        {
+            switch (Variant)
+            {
+            case 0: Sum += DecodeUnchecked(Messages[Index], &Unchecked); break;
+            case 1: Sum += DecodeValidated(Messages[Index], Messages[Index][0], &Validated); break;
+            default: Sum += Slave.ProcesDataRx(Messages[Index], Messages[Index][0]); break;
+            }
+        }
+    }
+    std::chrono::steady_clock::time_point Stop = std::chrono::steady_clock::now();
+
+    *SumPtr += Sum + Unchecked.LocInfo.Speed + Validated.LocInfo.Speed;
+
+    return (std::chrono::duration<double, std::nano>(Stop - Start).count() / (BENCH_REPEAT * BENCH_MESSAGES));
+}
+
+/***********************************************************************************************************************
+ */
+int main(int argc, char** argv)
+{
+    static const char* Names[] = { "Unchecked", "Validated", "ProcesDataRx" };
+    long Rounds                = (argc > 1) ? atol(argv[1]) : BENCH_ROUNDS;
+    long Round;
+    uint8_t Variant;
+    double Ns;
+    double Fastest[3] = { 1e9, 1e9, 1e9 };
+    unsigned long Sum = 0;
+
+    Prepare();
+    if (Compare() == false)
+    {
+        return (1);
+    }
+
+    for (Round = 0; Round < Rounds; Round++)
+    {
+        for (Variant = 0; Variant < 3; Variant++)
+        {
+            Ns = Run(Variant, &Sum);
+            if (Ns < Fastest[Variant])
+            {
+                Fastest[Variant] = Ns;
+            }
+        }
+    }
+
+    for (Variant = 0; Variant < 3; Variant++)
+    {
+        printf("%-13s %5.2f ns/message\n", Names[Variant], Fastest[Variant]);
+    }
+    printf("Validated / Unchecked: %.2f (%lu)\n", Fastest[1] / Fastest[0], Sum);
+
+    return ((Fastest[1] <= Fastest[0] * BENCH_LIMIT) ? 0 : 1);
+}
@@ -0,0 +1,166 @@
+/***********************************************************************************************************************
+   @file   Z21SlaveFuzz.cpp
+   @brief  Fuzz target for the receive path of Z21Slave on a host.
+
+   Build and run with random and truncated messages:
+     g++ -std=c++11 -g -fsanitize=address,undefined -Iextras/host -I. extras/host/Z21SlaveFuzz.cpp Z21*.cpp
+     ./a.out [iterations]
+
+   Or with libFuzzer:
+     clang++ -g -fsanitize=fuzzer,address,undefined -DZ21_FUZZ_LIBFUZZER -Iextras/host -I. \
+       extras/host/Z21SlaveFuzz.cpp Z21*.cpp
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+   I N C L U D E S
+ **********************************************************************************************************************/
+#include "Z21Slave.h"
+#include "Z21StationMap.h"
+#include <stdio.h>
+
+/***********************************************************************************************************************
+   D A T A   D E C L A R A T I O N S (exported, local)
+ **********************************************************************************************************************/
+
+static unsigned long Now = 0;
+static Z21Slave Slave;
+static Z21StationMap StationMap;
+
+/* Headers and X-Headers with a decoder, so most generated messages reach one. */
+static const uint8_t Headers[]  = { 0x10, 0x1A, 0x40, 0x84, 0x88, 0x89, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0x51 };
+static const uint8_t XHeaders[] = { 0x61, 0x62, 0x63, 0x64, 0x81, 0xE3, 0xE4, 0xE5, 0xEA, 0xEF, 0xF3 };
+
+/***********************************************************************************************************************
+  F U N C T I O N S
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ */
+unsigned long millis() { return (Now); }
+
+/***********************************************************************************************************************
+ * Feed one datagram to all receive functions. The data is copied to a buffer of exactly Size bytes, so the address
+ * sanitizer reports any read behind the datagram.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* Data, size_t Size)
+{
+    uint8_t* BufferPtr     = (uint8_t*)malloc((Size > 0) ? Size : 1);
+    uint16_t Length        = (Size > 0xFFFF) ? 0xFFFF : (uint16_t)Size;
+    uint16_t Offset        = 0;
+    uint16_t MessageLength = 0;
+    Z21Slave::dataType Type;
+    Z21LocoNetMessage* LocoNetPtr;
+
+    memcpy(BufferPtr, Data, Length);
+    Now += 10;
+
+    while (Offset < Length)
+    {
+        Type = Slave.ProcesDataRx(BufferPtr, Length, &Offset);
+
+        // The LocoNet view points into this datagram, a view of a previous datagram may not be used.
+        if ((Type == Z21Slave::locoNetRx) || (Type == Z21Slave::locoNetTx) || (Type == Z21Slave::locoNetFromLan))
+        {
+            LocoNetPtr = Slave.LanLocoNetMessage();
+            (void)LocoNetPtr->SlotAddress();
+            (void)LocoNetPtr->InputAddress();
+        }
+    }
+
+    Offset = 0;
+    do
+    {
+        StationMap.StationOfMessage(&BufferPtr[Offset], Length - Offset, &MessageLength);
+        Offset += MessageLength;
+    } while ((MessageLength > 0) && (Offset < Length));
+
+    free(BufferPtr);
+
+    return (0);
+}
+
+#ifndef Z21_FUZZ_LIBFUZZER
+
+/***********************************************************************************************************************
+ * Generate a datagram of random messages with mostly plausible DataLen, headers and XOR bytes.
+ */
+static uint16_t Generate(uint8_t* DataPtr, uint16_t Size)
+{
+    uint16_t Length = 0;
+    uint16_t MessageLength;
+    uint16_t Index;
+    uint8_t Checksum;
+
+    while ((Length < Size) && ((rand() % 3) != 0))
+    {
+        MessageLength = 4 + (rand() % 24);
+        if ((Length + MessageLength) > Size)
+        {
+            MessageLength = Size - Length;
+        }
+
+        for (Index = 0; Index < MessageLength; Index++)
+        {
+            DataPtr[Length + Index] = (uint8_t)rand();
+        }
+
+        if (MessageLength >= 4)
+        {
+            // Mostly the correct DataLen, sometimes a wrong one.
+            DataPtr[Length]     = ((rand() % 8) != 0) ? (uint8_t)MessageLength : (uint8_t)rand();
+            DataPtr[Length + 1] = ((rand() % 16) != 0) ? 0 : (uint8_t)rand();
+            DataPtr[Length + 2] = Headers[rand() % sizeof(Headers)];
+        }
+
+        if ((MessageLength >= 6) && (DataPtr[Length + 2] == 0x40))
+        {
+            DataPtr[Length + 4] = XHeaders[rand() % sizeof(XHeaders)];
+            if ((rand() % 2) != 0)
+            {
+                DataPtr[Length + 5] = 0xF1;
+            }
+
+            Checksum = 0;
+            for (Index = 4; Index < (MessageLength - 1); Index++)
+            {
+                Checksum ^= DataPtr[Length + Index];
+            }
+            DataPtr[Length + MessageLength - 1] = Checksum;
+        }
+
+        Length += MessageLength;
+    }
+
+    // Truncate the datagram in the middle of a message.
+    if ((Length > 0) && ((rand() % 4) == 0))
+    {
+        Length = rand() % Length;
+    }
+
+    return (Length);
+}
+
+/***********************************************************************************************************************
+ */
+int main(int argc, char** argv)
+{
+    uint8_t Data[128];
+    long Iterations = (argc > 1) ? atol(argv[1]) : 3000000;
+    long Index;
+
+    srand(1);
+    StationMap.SetDefault(0);
+    StationMap.Add(1, 99, 1);
+    StationMap.Add(100, 9999, 2);
+
+    for (Index = 0; Index < Iterations; Index++)
+    {
+        LLVMFuzzerTestOneInput(Data, Generate(Data, sizeof(Data)));
+    }
+
+    printf("%ld datagrams processed\n", Iterations);
+
+    return (0);
+}
+
+#endif